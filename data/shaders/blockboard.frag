@@ -0,0 +1,23 @@
+#version 330
+
+uniform sampler2D texUnit0; // Base texture
+uniform usampler2D texUnit1; // Colour index of each cell
+
+uniform vec4 colours[16];
+
+smooth in vec2 vertOutCell;
+
+out vec4 fragmentColor;
+
+void main()
+{
+  ivec2 size = textureSize(texUnit1, 0);
+  ivec2 cell = clamp(ivec2(vertOutCell), ivec2(0, 0), size - ivec2(1, 1));
+
+  // Row 0 of the board is at the bottom
+  uint colour = texelFetch(texUnit1, ivec2(cell.x, (size.y - 1) - cell.y), 0).r;
+
+  vec4 diffuse = texture(texUnit0, fract(vertOutCell));
+
+  fragmentColor = diffuse * colours[colour];
+}
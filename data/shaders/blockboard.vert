@@ -0,0 +1,24 @@
+#version 330
+
+uniform mat4 matModelViewProjection;
+
+uniform vec2 offset;
+uniform float scale;
+uniform vec2 blockSize;
+
+uniform usampler2D texUnit1; // Colour index of each cell
+
+#define POSITION 0
+
+// A corner of the unit quad, stretched over the whole board
+layout(location = POSITION) in vec2 position;
+
+// Cell coordinates for the fragment shader, y increases down the screen
+smooth out vec2 vertOutCell;
+
+void main()
+{
+  vec2 cells = vec2(textureSize(texUnit1, 0));
+  vertOutCell = position * cells;
+  gl_Position = matModelViewProjection * vec4(offset + (scale * blockSize * vertOutCell), 0.0, 1.0);
+}
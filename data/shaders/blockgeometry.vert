@@ -0,0 +1,28 @@
+#version 330
+
+uniform mat4 matModelViewProjection;
+
+uniform vec2 offset;
+uniform float scale;
+uniform vec4 texCoordRect; // The part of the texture to use (x, y, width, height)
+
+#define POSITION 0
+#define COLOUR 1
+
+layout(location = POSITION) in vec2 position;
+layout(location = COLOUR) in vec4 colour;
+
+// Texture coordinates for the fragment shader
+smooth out vec4 vertOutColour;
+smooth out vec2 vertOutTexCoord0;
+
+void main()
+{
+  gl_Position = matModelViewProjection * vec4(offset + (scale * position.xy), 0.0, 1.0);
+  vertOutColour = colour;
+
+  // Every block is four vertices starting at a multiple of four, in the order (0, 1), (1, 1), (1, 0), (0, 0)
+  int corner = gl_VertexID & 3;
+  vec2 texCoord = vec2(((corner == 1) || (corner == 2)) ? 1.0 : 0.0, (corner < 2) ? 1.0 : 0.0);
+  vertOutTexCoord0 = texCoordRect.xy + (texCoordRect.zw * texCoord);
+}
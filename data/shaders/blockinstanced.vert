@@ -0,0 +1,29 @@
+#version 330
+
+uniform mat4 matModelViewProjection;
+
+uniform vec2 offset;
+uniform float scale;
+uniform vec2 blockSize;
+uniform vec4 colours[16];
+
+#define POSITION 0
+#define INSTANCE 3
+
+// A corner of the unit quad, doubles as the texture coordinate
+layout(location = POSITION) in vec2 position;
+
+// x, y and colour index of this block
+layout(location = INSTANCE) in uvec4 instance;
+
+// Texture coordinates for the fragment shader
+smooth out vec4 vertOutColour;
+smooth out vec2 vertOutTexCoord0;
+
+void main()
+{
+  vec2 cell = vec2(instance.xy) + position;
+  gl_Position = matModelViewProjection * vec4(offset + (scale * blockSize * cell), 0.0, 1.0);
+  vertOutColour = colours[instance.z];
+  vertOutTexCoord0 = position;
+}
@@ -0,0 +1,27 @@
+#version 330
+
+uniform mat4 matModelViewProjection;
+
+#define POSITION 0
+#define INSTANCE_POSITION 1
+#define INSTANCE_COLOUR 2
+
+// A corner of the unit quad, doubles as the texture coordinate
+layout(location = POSITION) in vec2 position;
+
+// x, y and size of this particle
+layout(location = INSTANCE_POSITION) in vec3 instancePosition;
+layout(location = INSTANCE_COLOUR) in vec4 instanceColour;
+
+// Colour and texture coordinates for the fragment shader
+smooth out vec4 vertOutColour;
+smooth out vec2 vertOutTexCoord0;
+
+void main()
+{
+  // The particle is centred on its position
+  vec2 corner = instancePosition.xy + (instancePosition.z * (position - vec2(0.5, 0.5)));
+  gl_Position = matModelViewProjection * vec4(corner, 0.0, 1.0);
+  vertOutColour = instanceColour;
+  vertOutTexCoord0 = position;
+}
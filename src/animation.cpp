@@ -0,0 +1,90 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+
+#include <algorithm>
+
+// Tetris headers
+#include "animation.h"
+
+namespace
+{
+  const float PI = 3.14159265358979f;
+
+  // How far a landing piece pushes the board down in blocks
+  const float LOCK_BUMP_BLOCKS = 0.2f;
+
+  std::chrono::milliseconds GetDuration(ANIMATION type)
+  {
+    switch (type) {
+      case ANIMATION::LINE_CLEAR: return std::chrono::milliseconds(250);
+      case ANIMATION::GARBAGE_RISE: return std::chrono::milliseconds(150);
+      case ANIMATION::LOCK: return std::chrono::milliseconds(120);
+    }
+
+    assert(false);
+    return std::chrono::milliseconds(0);
+  }
+}
+
+// ** cAnimationTimeline
+
+void cAnimationTimeline::Add(ANIMATION type, size_t board, size_t value, clock::time_point now)
+{
+  // A piece landing restarts the bump rather than adding another one on top of it
+  if (type == ANIMATION::LOCK) {
+    const size_t n = animations.size();
+    for (size_t i = 0; i < n; i++) {
+      if ((animations[i].type == ANIMATION::LOCK) && (animations[i].board == board)) {
+        animations[i].start = now;
+        return;
+      }
+    }
+  }
+
+  cAnimation animation;
+  animation.type = type;
+  animation.board = board;
+  animation.value = value;
+  animation.start = now;
+  animations.push_back(animation);
+}
+
+void cAnimationTimeline::Update(clock::time_point now)
+{
+  size_t n = animations.size();
+  for (size_t i = 0; i < n;) {
+    if (GetProgress(animations[i], now) >= 1.0f) {
+      // The order doesn't matter so the last one is moved into the gap
+      animations[i] = animations[n - 1];
+      animations.pop_back();
+      n--;
+    } else i++;
+  }
+}
+
+float cAnimationTimeline::GetProgress(const cAnimation& animation, clock::time_point now)
+{
+  const float fElapsedMS = std::chrono::duration<float, std::milli>(now - animation.start).count();
+  const float fDurationMS = std::chrono::duration<float, std::milli>(GetDuration(animation.type)).count();
+  return std::max(0.0f, std::min(fElapsedMS / fDurationMS, 1.0f));
+}
+
+float cAnimationTimeline::GetBoardOffsetBlocks(size_t board, clock::time_point now) const
+{
+  float fOffset = 0.0f;
+
+  const size_t n = animations.size();
+  for (size_t i = 0; i < n; i++) {
+    const cAnimation& animation = animations[i];
+    if (animation.board != board) continue;
+
+    const float t = GetProgress(animation, now);
+    if (animation.type == ANIMATION::GARBAGE_RISE) {
+      // Ease out so that the lines slow down as they arrive
+      fOffset += float(animation.value) * (1.0f - t) * (1.0f - t);
+    } else if (animation.type == ANIMATION::LOCK) fOffset += LOCK_BUMP_BLOCKS * std::sin(PI * t);
+  }
+
+  return fOffset;
+}
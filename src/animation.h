@@ -0,0 +1,56 @@
+#ifndef TETRIS_ANIMATION_H
+#define TETRIS_ANIMATION_H
+
+// Standard headers
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+// ** cAnimationTimeline
+//
+// Short effects that are started by the events of the simulation and then drawn over the top of the cached boards.  The
+// simulation has already moved on by the time an effect starts, it never waits for one to finish, so they can't add any
+// input latency and a headless run just never creates a timeline.
+
+enum class ANIMATION {
+  LINE_CLEAR,   // A flash where the line was
+  GARBAGE_RISE, // The board starts lower and slides up into place
+  LOCK,         // The board bumps down a little when a piece lands
+};
+
+class cAnimation
+{
+public:
+  ANIMATION type;
+  size_t board;
+  size_t value; // The row for LINE_CLEAR and the number of lines for GARBAGE_RISE
+  std::chrono::steady_clock::time_point start;
+};
+
+class cAnimationTimeline
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  bool IsEmpty() const { return animations.empty(); }
+  void Clear() { animations.clear(); }
+
+  void Add(ANIMATION type, size_t board, size_t value, clock::time_point now);
+
+  // Forgets the animations that have finished
+  void Update(clock::time_point now);
+
+  size_t GetCount() const { return animations.size(); }
+  const cAnimation& Get(size_t i) const { return animations[i]; }
+
+  // How far through the animation we are from 0 to 1
+  static float GetProgress(const cAnimation& animation, clock::time_point now);
+
+  // How far down the screen the board is moved in blocks by garbage rising and pieces locking
+  float GetBoardOffsetBlocks(size_t board, clock::time_point now) const;
+
+private:
+  std::vector<cAnimation> animations;
+};
+
+#endif // TETRIS_ANIMATION_H
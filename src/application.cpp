@@ -18,6 +18,9 @@
 #include <GL/GLee.h>
 #include <GL/glu.h>
 
+// SDL headers
+#include <SDL2/SDL.h>
+
 // Spitfire headers
 #include <spitfire/spitfire.h>
 
@@ -52,10 +55,14 @@
 cApplication::cApplication(int argc, const char* const* argv) :
   breathe::util::cApplication(argc, argv),
 
+  bIsResourcesLoaded(false),
+
   pFont(nullptr),
 
   pGuiManager(nullptr),
-  pGuiRenderer(nullptr)
+  pGuiRenderer(nullptr),
+  guiRendererWidth(0),
+  guiRendererHeight(0)
 {
   settings.Load();
 }
@@ -87,6 +94,8 @@ bool cApplication::_Create()
   pGuiManager = new breathe::gui::cManager;
   pGuiRenderer = new breathe::gui::cRenderer(*pGuiManager, *pContext);
 
+  SetupFramePacing();
+
   _LoadResources();
 
   // Push our first state
@@ -97,16 +106,61 @@ bool cApplication::_Create()
 
 void cApplication::_Destroy()
 {
-  _DestroyResources();
+  DestroyAllResources();
 
   spitfire::SAFE_DELETE(pGuiRenderer);
   spitfire::SAFE_DELETE(pGuiManager);
 }
 
+void cApplication::SetupFramePacing()
+{
+  // Adaptive vsync tears instead of dropping to half the frame rate when a frame is late, not every driver supports it
+  const spitfire::string_t sVSync = settings.GetVSync();
+  bool bIsVSync = false;
+  if (sVSync == TEXT("adaptive")) {
+    bIsVSync = (SDL_GL_SetSwapInterval(-1) == 0);
+    if (!bIsVSync) {
+      std::cout<<"cApplication::SetupFramePacing Adaptive vsync is not supported, using vsync"<<std::endl;
+      bIsVSync = (SDL_GL_SetSwapInterval(1) == 0);
+    }
+  } else if (sVSync == TEXT("on")) bIsVSync = (SDL_GL_SetSwapInterval(1) == 0);
+  else SDL_GL_SetSwapInterval(0);
+
+  size_t framesPerSecond = settings.GetFrameRateLimit();
+  if (framesPerSecond == 0) {
+    // Waiting for vsync already limits us to the refresh rate, limiting it again would fight with the swap and drop frames
+    if (!bIsVSync) {
+      SDL_DisplayMode mode;
+      framesPerSecond = ((SDL_GetCurrentDisplayMode(0, &mode) == 0) && (mode.refresh_rate > 0)) ? size_t(mode.refresh_rate) : 60;
+    }
+  }
+
+  std::cout<<"cApplication::SetupFramePacing vsync "<<(bIsVSync ? "on" : "off")<<", frame rate limit "<<framesPerSecond<<std::endl;
+
+  framePacer.SetTargetFramesPerSecond(framesPerSecond);
+}
+
 bool cApplication::_LoadResources()
 {
   LOG("");
 
+  if (bIsResourcesLoaded) ResizeResources();
+  else LoadAllResources();
+
+  return true;
+}
+
+void cApplication::_DestroyResources()
+{
+  LOG("");
+
+  // This is only called when the window changes size, the resources are kept for _LoadResources to resize and are destroyed
+  // in _Destroy instead
+}
+
+void cApplication::LoadAllResources()
+{
+  assert(!bIsResourcesLoaded);
   assert(pGuiManager != nullptr);
   assert(pGuiRenderer != nullptr);
 
@@ -117,6 +171,8 @@ bool cApplication::_LoadResources()
   spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, pContext->GetWidth(), pContext->GetHeight());
 
   pGuiRenderer->LoadResources(letterBox.letterBoxedWidth, letterBox.letterBoxedHeight);
+  guiRendererWidth = letterBox.letterBoxedWidth;
+  guiRendererHeight = letterBox.letterBoxedHeight;
 
   // Load the resources of all the states
   std::list<breathe::util::cState*>::iterator iter = states.begin();
@@ -128,12 +184,42 @@ bool cApplication::_LoadResources()
     iter++;
   }
 
-  return true;
+  bIsResourcesLoaded = true;
 }
 
-void cApplication::_DestroyResources()
+void cApplication::ResizeResources()
 {
-  LOG("");
+  assert(bIsResourcesLoaded);
+  assert(pGuiRenderer != nullptr);
+
+  const size_t width = pContext->GetWidth();
+  const size_t height = pContext->GetHeight();
+
+  std::cout<<"cApplication::ResizeResources "<<width<<"x"<<height<<std::endl;
+
+  // The font, shaders and the vertex buffer objects of the game don't depend on the size of the window so they are kept
+  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
+  if ((letterBox.letterBoxedWidth != guiRendererWidth) || (letterBox.letterBoxedHeight != guiRendererHeight)) {
+    pGuiRenderer->DestroyResources();
+    pGuiRenderer->LoadResources(letterBox.letterBoxedWidth, letterBox.letterBoxedHeight);
+    guiRendererWidth = letterBox.letterBoxedWidth;
+    guiRendererHeight = letterBox.letterBoxedHeight;
+  }
+
+  // Resize the resources of all the states
+  std::list<breathe::util::cState*>::iterator iter = states.begin();
+  const std::list<breathe::util::cState*>::iterator iterEnd = states.end();
+  while (iter != iterEnd) {
+    cState* pState = static_cast<cState*>(*iter);
+    if (pState != nullptr) pState->ResizeResources();
+
+    iter++;
+  }
+}
+
+void cApplication::DestroyAllResources()
+{
+  if (!bIsResourcesLoaded) return;
 
   // Destroy the resources of all the states
   std::list<breathe::util::cState*>::iterator iter = states.begin();
@@ -154,6 +240,8 @@ void cApplication::_DestroyResources()
     pContext->DestroyFont(pFont);
     pFont = nullptr;
   }
+
+  bIsResourcesLoaded = false;
 }
 
 
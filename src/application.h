@@ -13,6 +13,7 @@
 #include <breathe/util/cApplication.h>
 
 // Tetris headers
+#include "framepacer.h"
 #include "settings.h"
 
 
@@ -40,12 +41,27 @@ private:
   virtual bool _LoadResources() override;
   virtual void _DestroyResources() override;
 
+  // The context is kept when the window is resized or goes fullscreen, so the first load creates everything, later loads only
+  // rebuild what depends on the size of the window and everything is destroyed when we exit
+  void LoadAllResources();
+  void ResizeResources();
+  void DestroyAllResources();
+
+  // Sets the swap interval and the frame rate limit from the settings
+  void SetupFramePacing();
+
+  cFramePacer framePacer;
+
+  bool bIsResourcesLoaded;
+
   // Text
   opengl::cFont* pFont;
 
   // Gui
   breathe::gui::cManager* pGuiManager;
   breathe::gui::cRenderer* pGuiRenderer;
+  size_t guiRendererWidth; // The letter boxed size that the gui renderer resources were loaded for
+  size_t guiRendererHeight;
 };
 
 #endif // TETRIS_APPLICATION_H
@@ -0,0 +1,1417 @@
+// Standard headers
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+
+#include <string>
+#include <iostream>
+
+#include <map>
+#include <vector>
+
+// SSE2 is always available on x86-64, anywhere else the blocks are built one field at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TETRIS_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Tetris headers
+#include "blockrenderer.h"
+
+namespace
+{
+  const GLuint ATTRIBUTE_POSITION = 0;
+  const GLuint ATTRIBUTE_COLOUR = 1;
+  const GLuint ATTRIBUTE_INSTANCE = 3;
+
+  const size_t VERTICES_PER_BLOCK = 4;
+  const size_t INDICES_PER_BLOCK = 6;
+
+  // Rows of the board render target atlas wrap at this width, every driver that we support can create a texture this big
+  const size_t MAX_ATLAS_WIDTH = 2048;
+
+  // For the currently bound vertex array and buffer, the texture coordinates are worked out in blockgeometry.vert
+  void SetBlockVertexAttributes()
+  {
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(cBlockVertex), (const GLvoid*)offsetof(cBlockVertex, x));
+    glEnableVertexAttribArray(ATTRIBUTE_COLOUR);
+    glVertexAttribPointer(ATTRIBUTE_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(cBlockVertex), (const GLvoid*)offsetof(cBlockVertex, r));
+  }
+
+  GLubyte ToNormalisedByte(float fValue)
+  {
+    return GLubyte((std::min(std::max(fValue, 0.0f), 1.0f) * 255.0f) + 0.5f);
+  }
+
+  uint32_t PackColour(const spitfire::math::cColour& colour)
+  {
+    const GLubyte packed[4] = { ToNormalisedByte(colour.r), ToNormalisedByte(colour.g), ToNormalisedByte(colour.b), ToNormalisedByte(colour.a) };
+
+    uint32_t value = 0;
+    std::memcpy(&value, packed, sizeof(value));
+    return value;
+  }
+
+  #ifdef TETRIS_SSE2
+  size_t CountTrailingZeros(uint32_t value)
+  {
+    assert(value != 0);
+
+    #ifdef _MSC_VER
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return size_t(index);
+    #else
+    return size_t(__builtin_ctz(value));
+    #endif
+  }
+  #endif
+
+  void PushBack(std::vector<cBlockVertex>& vertices, float x, float y, const GLubyte colour[4])
+  {
+    const cBlockVertex vertex = { x, y, colour[0], colour[1], colour[2], colour[3] };
+    vertices.push_back(vertex);
+  }
+
+  void PushBackBlock(std::vector<cBlockVertex>& vertices, size_t x, size_t y, const spitfire::math::cColour& colour, const spitfire::math::cVec2& blockSize)
+  {
+    const float x0 = blockSize.x * float(x);
+    const float x1 = blockSize.x * float(x + 1);
+    const float y0 = blockSize.y * float(y);
+    const float y1 = blockSize.y * float(y + 1);
+
+    const GLubyte packed[4] = { ToNormalisedByte(colour.r), ToNormalisedByte(colour.g), ToNormalisedByte(colour.b), ToNormalisedByte(colour.a) };
+
+    // The corners in the order that blockgeometry.vert expects, the shared indices make two front facing triangles
+    PushBack(vertices, x0, y1, packed);
+    PushBack(vertices, x1, y1, packed);
+    PushBack(vertices, x1, y0, packed);
+    PushBack(vertices, x0, y0, packed);
+  }
+}
+
+BLOCK_RENDERER GetBlockRendererFromName(const spitfire::string_t& sName)
+{
+  if (sName == TEXT("geometry")) return BLOCK_RENDERER::GEOMETRY;
+  else if (sName == TEXT("texture")) return BLOCK_RENDERER::TEXTURE;
+
+  return BLOCK_RENDERER::INSTANCED;
+}
+
+
+// ** cStreamingBuffer
+
+cStreamingBuffer::cStreamingBuffer() :
+  buffer(0),
+  nSegmentBytes(0),
+  iSegment(0)
+{
+}
+
+void cStreamingBuffer::Create(size_t nMaxBytes)
+{
+  assert(buffer == 0);
+
+  nSegmentBytes = nMaxBytes;
+  iSegment = 0;
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  glBufferData(GL_ARRAY_BUFFER, SEGMENTS * nSegmentBytes, nullptr, GL_STREAM_DRAW);
+}
+
+void cStreamingBuffer::Destroy()
+{
+  if (buffer != 0) {
+    glDeleteBuffers(1, &buffer);
+    buffer = 0;
+  }
+
+  nSegmentBytes = 0;
+  iSegment = 0;
+}
+
+size_t cStreamingBuffer::Write(const void* pData, size_t nBytes)
+{
+  assert(buffer != 0);
+  assert(nBytes <= nSegmentBytes);
+
+  iSegment++;
+  if (iSegment >= SEGMENTS) iSegment = 0;
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+  // Orphan the old storage rather than wait for the GPU to finish with the segment we are about to overwrite
+  if (iSegment == 0) glBufferData(GL_ARRAY_BUFFER, SEGMENTS * nSegmentBytes, nullptr, GL_STREAM_DRAW);
+
+  const size_t offset = iSegment * nSegmentBytes;
+  if (nBytes != 0) glBufferSubData(GL_ARRAY_BUFFER, offset, nBytes, pData);
+
+  return offset;
+}
+
+
+// ** cBlockInstanceBuffer
+
+cBlockInstanceBuffer::cBlockInstanceBuffer() :
+  vertexArrayObject(0),
+  nMaxInstances(0),
+  nInstances(0)
+{
+}
+
+
+// ** cBlockQuadEmitter
+
+cBlockQuadEmitter::cBlockQuadEmitter() :
+  width(0),
+  paddedWidth(0),
+  fBlockWidth(0.0f),
+  fBlockHeight(0.0f)
+{
+  std::fill(colours, colours + 256, 0);
+}
+
+void cBlockQuadEmitter::Create(size_t _width, const spitfire::math::cVec2& blockSize)
+{
+  width = _width;
+  paddedWidth = (width + 15) & ~size_t(15);
+  fBlockWidth = blockSize.x;
+  fBlockHeight = blockSize.y;
+
+  // The x parts of the stores, the y parts and the colours are zero here so they can be added and ored in afterwards
+  columns.resize(width);
+  for (size_t x = 0; x < width; x++) {
+    const float x0 = blockSize.x * float(x);
+    const float x1 = blockSize.x * float(x + 1);
+
+    cColumn& column = columns[x];
+    column.a[0] = x0; column.a[1] = 0.0f; column.a[2] = 0.0f; column.a[3] = x1;
+    column.b[0] = 0.0f; column.b[1] = 0.0f; column.b[2] = x1; column.b[3] = 0.0f;
+    column.c[0] = 0.0f; column.c[1] = x0; column.c[2] = 0.0f; column.c[3] = 0.0f;
+  }
+}
+
+void cBlockQuadEmitter::SetColour(size_t i, const spitfire::math::cColour& colour)
+{
+  assert(i < 256);
+  colours[i] = PackColour(colour);
+}
+
+void cBlockQuadEmitter::SetColours(const tetris::cBoardSnapshot& board)
+{
+  const size_t n = std::min<size_t>(board.GetColours(), 256);
+  for (size_t i = 0; i < n; i++) SetColour(i, board.GetColour(i));
+}
+
+size_t cBlockQuadEmitter::EmitRow(const uint8_t* pCells, size_t y, cBlockVertex* pVertices) const
+{
+  const float y0 = fBlockHeight * float(y);
+  const float y1 = fBlockHeight * float(y + 1);
+
+  size_t nBlocks = 0;
+
+  #ifdef TETRIS_SSE2
+  // The 48 bytes of a block are (x0, y1, c, x1) (y1, c, x1, y0) (c, x0, y0, c)
+  const __m128 rowA = _mm_setr_ps(0.0f, y1, 0.0f, 0.0f);
+  const __m128 rowB = _mm_setr_ps(y1, 0.0f, 0.0f, y0);
+  const __m128 rowC = _mm_setr_ps(0.0f, 0.0f, y0, 0.0f);
+  const __m128 colourA = _mm_castsi128_ps(_mm_setr_epi32(0, 0, -1, 0));
+  const __m128 colourB = _mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, 0));
+  const __m128 colourC = _mm_castsi128_ps(_mm_setr_epi32(-1, 0, 0, -1));
+  const __m128i zero = _mm_setzero_si128();
+
+  for (size_t first = 0; first < width; first += 16) {
+    // One bit for each occupied cell out of these 16
+    const __m128i cells = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pCells + first));
+    uint32_t occupied = uint32_t(~_mm_movemask_epi8(_mm_cmpeq_epi8(cells, zero))) & 0xFFFF;
+    if ((width - first) < 16) occupied &= (uint32_t(1) << (width - first)) - 1;
+
+    while (occupied != 0) {
+      const size_t x = first + CountTrailingZeros(occupied);
+      occupied &= occupied - 1;
+
+      const cColumn& column = columns[x];
+      const __m128 colour = _mm_castsi128_ps(_mm_set1_epi32(int(colours[pCells[x]])));
+
+      float* pOut = reinterpret_cast<float*>(pVertices + (VERTICES_PER_BLOCK * nBlocks));
+      _mm_storeu_ps(pOut, _mm_or_ps(_mm_add_ps(_mm_loadu_ps(column.a), rowA), _mm_and_ps(colour, colourA)));
+      _mm_storeu_ps(pOut + 4, _mm_or_ps(_mm_add_ps(_mm_loadu_ps(column.b), rowB), _mm_and_ps(colour, colourB)));
+      _mm_storeu_ps(pOut + 8, _mm_or_ps(_mm_add_ps(_mm_loadu_ps(column.c), rowC), _mm_and_ps(colour, colourC)));
+
+      nBlocks++;
+    }
+  }
+  #else
+  for (size_t x = 0; x < width; x++) {
+    if (pCells[x] == 0) continue;
+
+    const cColumn& column = columns[x];
+    const float x0 = column.a[0];
+    const float x1 = column.a[3];
+
+    cBlockVertex* pOut = pVertices + (VERTICES_PER_BLOCK * nBlocks);
+    pOut[0].x = x0; pOut[0].y = y1;
+    pOut[1].x = x1; pOut[1].y = y1;
+    pOut[2].x = x1; pOut[2].y = y0;
+    pOut[3].x = x0; pOut[3].y = y0;
+    for (size_t i = 0; i < VERTICES_PER_BLOCK; i++) std::memcpy(&pOut[i].r, &colours[pCells[x]], sizeof(uint32_t));
+
+    nBlocks++;
+  }
+  #endif
+
+  return VERTICES_PER_BLOCK * nBlocks;
+}
+
+
+// ** cBoardGeometryBuffer
+
+cBoardGeometryBuffer::cBoardGeometryBuffer() :
+  vertexArrayObject(0),
+  bufferVertices(0),
+  width(0),
+  height(0)
+{
+}
+
+
+// ** cPieceGeometryBuffer
+
+cPieceGeometryBuffer::cPieceGeometryBuffer() :
+  vertexArrayObject(0),
+  nMaxVertices(0),
+  first(0),
+  count(0)
+{
+}
+
+
+// ** cBoardTexture
+
+cBoardTexture::cBoardTexture() :
+  vertexArrayObject(0),
+  texture(0),
+  width(0),
+  height(0)
+{
+}
+
+
+// ** cBoardRenderTargetAtlas
+
+cBoardRenderTargetAtlas::cBoardRenderTargetAtlas() :
+  frameBufferObject(0),
+  texture(0),
+  textureWidth(0),
+  textureHeight(0),
+  rowX(0),
+  rowY(0),
+  rowHeight(0)
+{
+}
+
+size_t cBoardRenderTargetAtlas::Add(size_t width, size_t height)
+{
+  assert(!IsValid());
+  assert(width <= MAX_ATLAS_WIDTH);
+
+  // Start a new row if this one is full
+  if ((rowX + width) > MAX_ATLAS_WIDTH) {
+    rowX = 0;
+    rowY += rowHeight;
+    rowHeight = 0;
+  }
+
+  const cRectangle rectangle = { rowX, rowY, width, height };
+  rectangles.push_back(rectangle);
+
+  rowX += width;
+  rowHeight = std::max(rowHeight, height);
+
+  textureWidth = std::max(textureWidth, rowX);
+  textureHeight = std::max(textureHeight, rowY + rowHeight);
+
+  return rectangles.size() - 1;
+}
+
+
+// ** cBoardRenderTarget
+
+cBoardRenderTarget::cBoardRenderTarget() :
+  frameBufferObject(0),
+  texture(0),
+  vertexArrayObject(0),
+  bufferVertices(0),
+  x(0),
+  y(0),
+  textureWidth(0),
+  textureHeight(0)
+{
+  texCoordRect[0] = 0.0f;
+  texCoordRect[1] = 0.0f;
+  texCoordRect[2] = 1.0f;
+  texCoordRect[3] = 1.0f;
+}
+
+
+// ** cPieceMeshCache
+
+cPieceMeshCache::cPieceMeshCache() :
+  mode(BLOCK_RENDERER::GEOMETRY),
+  vertexArrayObject(0),
+  buffer(0)
+{
+}
+
+uint64_t cPieceMeshCache::_GetKey(const tetris::cPiece& piece)
+{
+  // 64 bit FNV-1a offset basis
+  return piece.GetStateHash(14695981039346656037ULL);
+}
+
+cPieceMeshRange cPieceMeshCache::Find(const tetris::cPiece& piece) const
+{
+  std::map<uint64_t, cPieceMeshRange>::const_iterator iter = ranges.find(_GetKey(piece));
+  if (iter == ranges.end()) return cPieceMeshRange();
+
+  return iter->second;
+}
+
+
+// ** cBlockRenderQueue
+
+void cBlockRenderQueue::_Add(BLOCK_LAYER layer, GLuint vertexArrayObject, DRAW draw, GLint first, GLsizei count, const spitfire::math::cVec2& position)
+{
+  cItem item;
+  item.key = (uint64_t(layer) << 32) | uint64_t(vertexArrayObject);
+  item.vertexArrayObject = vertexArrayObject;
+  item.draw = draw;
+  item.first = first;
+  item.count = count;
+  item.pBaseVertex = nullptr;
+  item.pCount = nullptr;
+  item.pIndices = nullptr;
+  item.nDraws = 0;
+  item.bufferInstances = 0;
+  item.instancesOffset = 0;
+  item.texture = 0;
+  item.pTexCoordRect = nullptr;
+  item.position = position;
+  item.fScale = 1.0f;
+
+  items.push_back(item);
+}
+
+void cBlockRenderQueue::AddBoardGeometry(const cBoardGeometryBuffer& buffer, const spitfire::math::cVec2& position)
+{
+  assert(buffer.IsValid());
+
+  const size_t nBlocksBoard = buffer.width * buffer.height;
+  _Add(BLOCK_LAYER::BACKGROUND, buffer.vertexArrayObject, DRAW::ELEMENTS, GLint(VERTICES_PER_BLOCK * nBlocksBoard), GLsizei(INDICES_PER_BLOCK * nBlocksBoard), position);
+
+  _Add(BLOCK_LAYER::BLOCKS, buffer.vertexArrayObject, DRAW::MULTI_ELEMENTS, 0, 0, position);
+  cItem& item = items.back();
+  item.pBaseVertex = &buffer.rowBaseVertex[0];
+  item.pCount = &buffer.rowCount[0];
+  item.pIndices = &buffer.rowIndices[0];
+  item.nDraws = GLsizei(buffer.height);
+}
+
+void cBlockRenderQueue::AddPieceGeometry(const cPieceGeometryBuffer& buffer, const spitfire::math::cVec2& position)
+{
+  assert(buffer.IsValid());
+  if (buffer.count == 0) return;
+
+  _Add(BLOCK_LAYER::BLOCKS, buffer.vertexArrayObject, DRAW::ELEMENTS, buffer.first, buffer.count, position);
+}
+
+void cBlockRenderQueue::AddInstances(BLOCK_LAYER layer, const cBlockInstanceBuffer& buffer, const spitfire::math::cVec2& position)
+{
+  assert(buffer.IsValid());
+  if (buffer.nInstances == 0) return;
+
+  _Add(layer, buffer.vertexArrayObject, DRAW::INSTANCED, 0, GLsizei(buffer.nInstances), position);
+}
+
+void cBlockRenderQueue::AddPieceMesh(const cPieceMeshCache& cache, const cPieceMeshRange& range, const spitfire::math::cVec2& position)
+{
+  assert(cache.IsValid());
+  if (!range.IsValid()) return;
+
+  if (cache.mode == BLOCK_RENDERER::INSTANCED) {
+    _Add(BLOCK_LAYER::BLOCKS, cache.vertexArrayObject, DRAW::INSTANCED, 0, range.count, position);
+
+    // There is no base instance in OpenGL 3.3 so we point the instance attribute at the start of the range instead
+    cItem& item = items.back();
+    item.bufferInstances = cache.buffer;
+    item.instancesOffset = range.first * sizeof(cBlockInstance);
+  } else {
+    _Add(BLOCK_LAYER::BLOCKS, cache.vertexArrayObject, DRAW::ELEMENTS, range.first, range.count, position);
+  }
+}
+
+void cBlockRenderQueue::AddBoardTexture(const cBoardTexture& texture, const spitfire::math::cVec2& position)
+{
+  assert(texture.IsValid());
+
+  // The background and the blocks are drawn together
+  _Add(BLOCK_LAYER::BACKGROUND, texture.vertexArrayObject, DRAW::BOARD_TEXTURE, 0, 4, position);
+  items.back().texture = texture.texture;
+}
+
+void cBlockRenderQueue::AddBoardRenderTarget(const cBoardRenderTarget& target, const spitfire::math::cVec2& position, float fScale)
+{
+  assert(target.IsValid());
+
+  _Add(BLOCK_LAYER::BACKGROUND, target.vertexArrayObject, DRAW::RENDER_TARGET, 0, GLsizei(INDICES_PER_BLOCK), position);
+  cItem& item = items.back();
+  item.texture = target.texture;
+  item.pTexCoordRect = target.texCoordRect;
+  item.fScale = fScale;
+}
+
+
+// ** cBlockRenderer
+
+cBlockRenderer::cBlockRenderer() :
+  bufferQuad(0),
+  bufferQuadIndices(0),
+  previousFrameBufferObject(0),
+  previousFrontFace(GL_CCW),
+  bIsPreviousScissorTestEnabled(false)
+{
+  previousViewport[0] = 0;
+  previousViewport[1] = 0;
+  previousViewport[2] = 0;
+  previousViewport[3] = 0;
+}
+
+cBlockRenderer::~cBlockRenderer()
+{
+  assert(bufferQuad == 0);
+  assert(bufferQuadIndices == 0);
+}
+
+void cBlockRenderer::Create()
+{
+  assert(bufferQuad == 0);
+
+  // A unit quad as a triangle strip, the corners are also the texture coordinates
+  const GLfloat quad[] = {
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    0.0f, 0.0f,
+    1.0f, 0.0f
+  };
+
+  glGenBuffers(1, &bufferQuad);
+  glBindBuffer(GL_ARRAY_BUFFER, bufferQuad);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // Two triangles for every four vertices, shared by all of the geometry so that only the corners are ever uploaded
+  std::vector<GLushort> indices;
+  indices.reserve(INDICES_PER_BLOCK * MAX_INDEXED_BLOCKS);
+  for (size_t i = 0; i < MAX_INDEXED_BLOCKS; i++) {
+    const GLushort first = GLushort(VERTICES_PER_BLOCK * i);
+    indices.push_back(first);
+    indices.push_back(first + 1);
+    indices.push_back(first + 2);
+    indices.push_back(first + 2);
+    indices.push_back(first + 3);
+    indices.push_back(first);
+  }
+
+  glGenBuffers(1, &bufferQuadIndices);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferQuadIndices);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::Destroy()
+{
+  if (bufferQuad != 0) {
+    glDeleteBuffers(1, &bufferQuad);
+    bufferQuad = 0;
+  }
+
+  if (bufferQuadIndices != 0) {
+    glDeleteBuffers(1, &bufferQuadIndices);
+    bufferQuadIndices = 0;
+  }
+}
+
+void cBlockRenderer::CreateInstanceBuffer(cBlockInstanceBuffer& buffer, size_t nMaxInstances)
+{
+  assert(bufferQuad != 0);
+  assert(!buffer.IsValid());
+
+  buffer.nMaxInstances = nMaxInstances;
+  buffer.nInstances = 0;
+
+  glGenVertexArrays(1, &buffer.vertexArrayObject);
+  glBindVertexArray(buffer.vertexArrayObject);
+
+  glBindBuffer(GL_ARRAY_BUFFER, bufferQuad);
+  glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+  glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+
+  buffer.instances.Create(nMaxInstances * sizeof(cBlockInstance));
+  glEnableVertexAttribArray(ATTRIBUTE_INSTANCE);
+  glVertexAttribIPointer(ATTRIBUTE_INSTANCE, 4, GL_UNSIGNED_BYTE, sizeof(cBlockInstance), nullptr);
+  glVertexAttribDivisor(ATTRIBUTE_INSTANCE, 1);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::DestroyInstanceBuffer(cBlockInstanceBuffer& buffer)
+{
+  buffer.instances.Destroy();
+
+  if (buffer.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &buffer.vertexArrayObject);
+    buffer.vertexArrayObject = 0;
+  }
+
+  buffer.nMaxInstances = 0;
+  buffer.nInstances = 0;
+}
+
+void cBlockRenderer::SetInstances(cBlockInstanceBuffer& buffer, const std::vector<cBlockInstance>& instances)
+{
+  assert(buffer.IsValid());
+  assert(instances.size() <= buffer.nMaxInstances);
+
+  buffer.nInstances = instances.size();
+  if (instances.empty()) return;
+
+  const size_t offset = buffer.instances.Write(&instances[0], instances.size() * sizeof(cBlockInstance));
+
+  // Point the instance attribute at the segment we just wrote to
+  glBindVertexArray(buffer.vertexArrayObject);
+  glVertexAttribIPointer(ATTRIBUTE_INSTANCE, 4, GL_UNSIGNED_BYTE, sizeof(cBlockInstance), (const GLvoid*)offset);
+  glBindVertexArray(0);
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::_BeginRows(size_t width, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  if (!emitter.IsCreatedFor(width, blockSize)) emitter.Create(width, blockSize);
+  emitter.SetColours(board);
+
+  cells.assign(emitter.GetPaddedWidth(), 0);
+}
+
+void cBlockRenderer::_AppendRow(size_t y)
+{
+  // Make room for every cell to be occupied and then trim it back to the blocks that were written
+  const size_t offset = vertices.size();
+  vertices.resize(offset + (VERTICES_PER_BLOCK * emitter.GetPaddedWidth()));
+  const size_t nVertices = emitter.EmitRow(&cells[0], y, &vertices[offset]);
+  vertices.resize(offset + nVertices);
+}
+
+void cBlockRenderer::_AppendPiece(const tetris::cPiece& piece, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  const size_t width = piece.GetWidth();
+  const size_t height = piece.GetHeight();
+
+  _BeginRows(width, board, blockSize);
+
+  for (size_t _y = 0; _y < height; _y++) {
+    // We want to add the blocks in upside down order
+    const size_t y = (height - 1) - _y;
+
+    for (size_t x = 0; x < width; x++) cells[x] = uint8_t(piece.GetBlock(x, _y));
+    _AppendRow(y);
+  }
+}
+
+GLint cBlockRenderer::_GetUniformLocation(const char* szName) const
+{
+  GLint program = 0;
+  glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+  assert(program != 0);
+
+  return glGetUniformLocation(GLuint(program), szName);
+}
+
+void cBlockRenderer::SetBlockSize(const spitfire::math::cVec2& blockSize)
+{
+  glUniform2f(_GetUniformLocation("blockSize"), blockSize.x, blockSize.y);
+}
+
+void cBlockRenderer::SetColours(const tetris::cBoardSnapshot& board)
+{
+  const size_t n = board.GetColours();
+  assert(n <= MAX_COLOURS);
+
+  GLfloat colours[4 * MAX_COLOURS];
+  for (size_t i = 0; i < n; i++) {
+    const spitfire::math::cColour colour(board.GetColour(i));
+    colours[(4 * i)] = colour.r;
+    colours[(4 * i) + 1] = colour.g;
+    colours[(4 * i) + 2] = colour.b;
+    colours[(4 * i) + 3] = colour.a;
+  }
+
+  glUniform4fv(_GetUniformLocation("colours"), GLsizei(n), colours);
+}
+
+void cBlockRenderer::BuildBoardInstances(const tetris::cBoardSnapshot& board, std::vector<cBlockInstance>& instances)
+{
+  instances.clear();
+
+  const size_t width = board.GetWidth();
+  const size_t height = board.GetHeight();
+  for (size_t _y = 0; _y < height; _y++) {
+    for (size_t x = 0; x < width; x++) {
+      const int c = board.GetBlock(x, _y);
+      if (c != 0) {
+        // We want to add the blocks in upside down order
+        const size_t y = (height - 1) - _y;
+
+        const cBlockInstance instance = { uint8_t(x), uint8_t(y), uint8_t(c), 0 };
+        instances.push_back(instance);
+      }
+    }
+  }
+}
+
+void cBlockRenderer::BuildBackgroundInstances(const tetris::cBoardSnapshot& board, std::vector<cBlockInstance>& instances)
+{
+  instances.clear();
+
+  const size_t width = board.GetWidth();
+  const size_t height = board.GetHeight();
+  for (size_t y = 0; y < height; y++) {
+    for (size_t x = 0; x < width; x++) {
+      const cBlockInstance instance = { uint8_t(x), uint8_t(y), 0, 0 };
+      instances.push_back(instance);
+    }
+  }
+}
+
+void cBlockRenderer::BuildPieceInstances(const tetris::cPiece& piece, std::vector<cBlockInstance>& instances)
+{
+  instances.clear();
+
+  const size_t width = piece.GetWidth();
+  const size_t height = piece.GetHeight();
+  for (size_t _y = 0; _y < height; _y++) {
+    for (size_t x = 0; x < width; x++) {
+      const int c = piece.GetBlock(x, _y);
+      if (c != 0) {
+        // We want to add the blocks in upside down order
+        const size_t y = (height - 1) - _y;
+
+        const cBlockInstance instance = { uint8_t(x), uint8_t(y), uint8_t(c), 0 };
+        instances.push_back(instance);
+      }
+    }
+  }
+}
+
+void cBlockRenderer::CreateBoardGeometryBuffer(cBoardGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  assert(bufferQuadIndices != 0);
+  assert(!buffer.IsValid());
+
+  buffer.width = board.GetWidth();
+  buffer.height = board.GetHeight();
+  assert((buffer.width * buffer.height) <= MAX_INDEXED_BLOCKS);
+
+  const size_t nVerticesPerRow = VERTICES_PER_BLOCK * buffer.width;
+  const size_t nVerticesBoard = nVerticesPerRow * buffer.height;
+
+  // Every row starts at the beginning of the shared indices, the base vertex moves it to the slot for the row
+  buffer.rowBaseVertex.resize(buffer.height);
+  for (size_t y = 0; y < buffer.height; y++) buffer.rowBaseVertex[y] = GLint(y * nVerticesPerRow);
+  buffer.rowCount.assign(buffer.height, 0);
+  buffer.rowIndices.assign(buffer.height, nullptr);
+
+  // Nothing has been uploaded yet so every row is out of date
+  buffer.rowRevisions.assign(buffer.height, uint64_t(-1));
+
+  glGenVertexArrays(1, &buffer.vertexArrayObject);
+  glBindVertexArray(buffer.vertexArrayObject);
+
+  // The rows followed by the empty cells for the background
+  glGenBuffers(1, &buffer.bufferVertices);
+  glBindBuffer(GL_ARRAY_BUFFER, buffer.bufferVertices);
+  glBufferData(GL_ARRAY_BUFFER, 2 * nVerticesBoard * sizeof(cBlockVertex), nullptr, GL_DYNAMIC_DRAW);
+
+  SetBlockVertexAttributes();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferQuadIndices);
+
+  glBindVertexArray(0);
+
+  vertices.clear();
+  const spitfire::math::cColour colour(board.GetColour(0));
+  for (size_t y = 0; y < buffer.height; y++) {
+    for (size_t x = 0; x < buffer.width; x++) PushBackBlock(vertices, x, y, colour, blockSize);
+  }
+
+  glBufferSubData(GL_ARRAY_BUFFER, nVerticesBoard * sizeof(cBlockVertex), vertices.size() * sizeof(cBlockVertex), &vertices[0]);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  UpdateBoardGeometry(buffer, board, blockSize);
+}
+
+void cBlockRenderer::DestroyBoardGeometryBuffer(cBoardGeometryBuffer& buffer)
+{
+  if (buffer.bufferVertices != 0) {
+    glDeleteBuffers(1, &buffer.bufferVertices);
+    buffer.bufferVertices = 0;
+  }
+
+  if (buffer.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &buffer.vertexArrayObject);
+    buffer.vertexArrayObject = 0;
+  }
+
+  buffer.rowBaseVertex.clear();
+  buffer.rowCount.clear();
+  buffer.rowIndices.clear();
+  buffer.rowRevisions.clear();
+}
+
+size_t cBlockRenderer::UpdateBoardGeometry(cBoardGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  assert(buffer.IsValid());
+  assert(board.GetWidth() == buffer.width);
+  assert(board.GetHeight() == buffer.height);
+
+  size_t nRowsUploaded = 0;
+
+  _BeginRows(buffer.width, board, blockSize);
+
+  glBindBuffer(GL_ARRAY_BUFFER, buffer.bufferVertices);
+
+  const size_t width = buffer.width;
+  const size_t height = buffer.height;
+  for (size_t _y = 0; _y < height; _y++) {
+    const uint64_t revision = board.GetRowRevision(_y);
+    if (revision == buffer.rowRevisions[_y]) continue;
+
+    buffer.rowRevisions[_y] = revision;
+
+    // We want to add the blocks in upside down order
+    const size_t y = (height - 1) - _y;
+
+    vertices.clear();
+    for (size_t x = 0; x < width; x++) cells[x] = uint8_t(board.GetBlock(x, _y));
+    _AppendRow(y);
+
+    buffer.rowCount[_y] = GLsizei((vertices.size() / VERTICES_PER_BLOCK) * INDICES_PER_BLOCK);
+    if (!vertices.empty()) glBufferSubData(GL_ARRAY_BUFFER, buffer.rowBaseVertex[_y] * sizeof(cBlockVertex), vertices.size() * sizeof(cBlockVertex), &vertices[0]);
+
+    nRowsUploaded++;
+  }
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  return nRowsUploaded;
+}
+
+void cBlockRenderer::CreatePieceGeometryBuffer(cPieceGeometryBuffer& buffer, size_t nMaxBlocks)
+{
+  assert(bufferQuadIndices != 0);
+  assert(!buffer.IsValid());
+  assert(nMaxBlocks <= MAX_INDEXED_BLOCKS);
+
+  buffer.nMaxVertices = VERTICES_PER_BLOCK * nMaxBlocks;
+  buffer.first = 0;
+  buffer.count = 0;
+
+  glGenVertexArrays(1, &buffer.vertexArrayObject);
+  glBindVertexArray(buffer.vertexArrayObject);
+
+  buffer.vertices.Create(buffer.nMaxVertices * sizeof(cBlockVertex));
+  SetBlockVertexAttributes();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferQuadIndices);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::DestroyPieceGeometryBuffer(cPieceGeometryBuffer& buffer)
+{
+  buffer.vertices.Destroy();
+
+  if (buffer.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &buffer.vertexArrayObject);
+    buffer.vertexArrayObject = 0;
+  }
+
+  buffer.nMaxVertices = 0;
+  buffer.first = 0;
+  buffer.count = 0;
+}
+
+void cBlockRenderer::UpdatePieceGeometry(cPieceGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const tetris::cPiece& piece, const spitfire::math::cVec2& blockSize)
+{
+  assert(buffer.IsValid());
+
+  vertices.clear();
+  _AppendPiece(piece, board, blockSize);
+
+  _UploadPieceGeometry(buffer);
+}
+
+void cBlockRenderer::UpdateQuadGeometry(cPieceGeometryBuffer& buffer, const std::vector<cBlockQuad>& quads)
+{
+  assert(buffer.IsValid());
+
+  vertices.clear();
+
+  const size_t n = std::min(quads.size(), buffer.nMaxVertices / VERTICES_PER_BLOCK);
+  for (size_t i = 0; i < n; i++) {
+    const cBlockQuad& quad = quads[i];
+    const float x0 = quad.position.x;
+    const float x1 = quad.position.x + quad.size.x;
+    const float y0 = quad.position.y;
+    const float y1 = quad.position.y + quad.size.y;
+
+    const GLubyte packed[4] = { ToNormalisedByte(quad.colour.r), ToNormalisedByte(quad.colour.g), ToNormalisedByte(quad.colour.b), ToNormalisedByte(quad.colour.a) };
+
+    // The same corners as PushBackBlock
+    PushBack(vertices, x0, y1, packed);
+    PushBack(vertices, x1, y1, packed);
+    PushBack(vertices, x1, y0, packed);
+    PushBack(vertices, x0, y0, packed);
+  }
+
+  _UploadPieceGeometry(buffer);
+}
+
+void cBlockRenderer::_UploadPieceGeometry(cPieceGeometryBuffer& buffer)
+{
+  assert(vertices.size() <= buffer.nMaxVertices);
+
+  buffer.count = GLsizei((vertices.size() / VERTICES_PER_BLOCK) * INDICES_PER_BLOCK);
+  if (vertices.empty()) return;
+
+  // The attributes point at the start of the buffer so the base vertex is the start of the segment that we wrote to
+  const size_t offset = buffer.vertices.Write(&vertices[0], vertices.size() * sizeof(cBlockVertex));
+  buffer.first = GLint(offset / sizeof(cBlockVertex));
+
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::CreatePieceMeshCache(cPieceMeshCache& cache, BLOCK_RENDERER mode, const std::vector<tetris::cPiece>& pieces, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  assert(bufferQuad != 0);
+  assert(bufferQuadIndices != 0);
+  assert(!cache.IsValid());
+
+  cache.mode = mode;
+  cache.ranges.clear();
+
+  std::vector<cBlockInstance> allInstances;
+  std::vector<cBlockInstance> pieceInstances;
+  vertices.clear();
+
+  const size_t n = pieces.size();
+  for (size_t i = 0; i < n; i++) {
+    tetris::cPiece piece = pieces[i];
+    for (size_t orientation = 0; orientation < 4; orientation++) {
+      if (orientation != 0) piece = piece.GetRotatedClockWise();
+
+      // Symmetrical pieces look the same in more than one orientation
+      const uint64_t key = cPieceMeshCache::_GetKey(piece);
+      if (cache.ranges.find(key) != cache.ranges.end()) continue;
+
+      cPieceMeshRange range;
+
+      if (mode == BLOCK_RENDERER::INSTANCED) {
+        BuildPieceInstances(piece, pieceInstances);
+        range.first = GLint(allInstances.size());
+        range.count = GLsizei(pieceInstances.size());
+        allInstances.insert(allInstances.end(), pieceInstances.begin(), pieceInstances.end());
+      } else {
+        range.first = GLint(vertices.size());
+        _AppendPiece(piece, board, blockSize);
+
+        range.count = GLsizei(((vertices.size() - range.first) / VERTICES_PER_BLOCK) * INDICES_PER_BLOCK);
+      }
+
+      if (range.IsValid()) cache.ranges[key] = range;
+    }
+  }
+
+  glGenVertexArrays(1, &cache.vertexArrayObject);
+  glBindVertexArray(cache.vertexArrayObject);
+
+  if (mode == BLOCK_RENDERER::INSTANCED) {
+    glBindBuffer(GL_ARRAY_BUFFER, bufferQuad);
+    glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+    glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+
+    glGenBuffers(1, &cache.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cache.buffer);
+    glBufferData(GL_ARRAY_BUFFER, allInstances.size() * sizeof(cBlockInstance), allInstances.empty() ? nullptr : &allInstances[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(ATTRIBUTE_INSTANCE);
+    glVertexAttribIPointer(ATTRIBUTE_INSTANCE, 4, GL_UNSIGNED_BYTE, sizeof(cBlockInstance), nullptr);
+    glVertexAttribDivisor(ATTRIBUTE_INSTANCE, 1);
+  } else {
+    glGenBuffers(1, &cache.buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, cache.buffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(cBlockVertex), vertices.empty() ? nullptr : &vertices[0], GL_STATIC_DRAW);
+
+    SetBlockVertexAttributes();
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferQuadIndices);
+  }
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  std::cout<<"cBlockRenderer::CreatePieceMeshCache "<<cache.ranges.size()<<" meshes for "<<n<<" pieces"<<std::endl;
+}
+
+void cBlockRenderer::DestroyPieceMeshCache(cPieceMeshCache& cache)
+{
+  if (cache.buffer != 0) {
+    glDeleteBuffers(1, &cache.buffer);
+    cache.buffer = 0;
+  }
+
+  if (cache.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &cache.vertexArrayObject);
+    cache.vertexArrayObject = 0;
+  }
+
+  cache.ranges.clear();
+}
+
+void cBlockRenderer::CreateBoardTexture(cBoardTexture& texture, const tetris::cBoardSnapshot& board)
+{
+  assert(bufferQuad != 0);
+  assert(!texture.IsValid());
+
+  texture.width = board.GetWidth();
+  texture.height = board.GetHeight();
+
+  // Nothing has been uploaded yet so every row is out of date
+  texture.rowRevisions.assign(texture.height, uint64_t(-1));
+
+  glGenVertexArrays(1, &texture.vertexArrayObject);
+  glBindVertexArray(texture.vertexArrayObject);
+
+  glBindBuffer(GL_ARRAY_BUFFER, bufferQuad);
+  glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+  glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // Colour indices are looked up with texelFetch so there is no filtering and no mipmaps
+  glGenTextures(1, &texture.texture);
+  glBindTexture(GL_TEXTURE_2D, texture.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, GLsizei(texture.width), GLsizei(texture.height), 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  UpdateBoardTexture(texture, board);
+}
+
+void cBlockRenderer::DestroyBoardTexture(cBoardTexture& texture)
+{
+  if (texture.texture != 0) {
+    glDeleteTextures(1, &texture.texture);
+    texture.texture = 0;
+  }
+
+  if (texture.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &texture.vertexArrayObject);
+    texture.vertexArrayObject = 0;
+  }
+
+  texture.rowRevisions.clear();
+  texture.texels.clear();
+}
+
+size_t cBlockRenderer::UpdateBoardTexture(cBoardTexture& texture, const tetris::cBoardSnapshot& board)
+{
+  assert(texture.IsValid());
+  assert(board.GetWidth() == texture.width);
+  assert(board.GetHeight() == texture.height);
+
+  // Find the span of rows that have changed, usually a few rows at the bottom of the board or one row after a piece lands
+  const size_t width = texture.width;
+  const size_t height = texture.height;
+  size_t first = height;
+  size_t last = 0;
+  for (size_t y = 0; y < height; y++) {
+    const uint64_t revision = board.GetRowRevision(y);
+    if (revision == texture.rowRevisions[y]) continue;
+
+    texture.rowRevisions[y] = revision;
+    if (y < first) first = y;
+    last = y + 1;
+  }
+
+  if (first >= last) return 0;
+
+  // Rows of the texture are in the same order as the board, the shader flips them
+  texture.texels.resize((last - first) * width);
+  for (size_t y = first; y < last; y++) {
+    for (size_t x = 0; x < width; x++) texture.texels[((y - first) * width) + x] = uint8_t(board.GetBlock(x, y));
+  }
+
+  glBindTexture(GL_TEXTURE_2D, texture.texture);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(first), GLsizei(width), GLsizei(last - first), GL_RED_INTEGER, GL_UNSIGNED_BYTE, &texture.texels[0]);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  return (last - first);
+}
+
+bool cBlockRenderer::CreateBoardRenderTargetAtlas(cBoardRenderTargetAtlas& atlas)
+{
+  assert(!atlas.IsValid());
+  assert(!atlas.rectangles.empty());
+
+  GLint maxTextureSize = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+  if ((atlas.textureWidth > size_t(maxTextureSize)) || (atlas.textureHeight > size_t(maxTextureSize))) {
+    std::cout<<"cBlockRenderer::CreateBoardRenderTargetAtlas Atlas "<<atlas.textureWidth<<"x"<<atlas.textureHeight<<" is bigger than the maximum texture size "<<maxTextureSize<<std::endl;
+    return false;
+  }
+
+  glGenTextures(1, &atlas.texture);
+  glBindTexture(GL_TEXTURE_2D, atlas.texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, GLsizei(atlas.textureWidth), GLsizei(atlas.textureHeight), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  GLint previous = 0;
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previous);
+
+  glGenFramebuffers(1, &atlas.frameBufferObject);
+  glBindFramebuffer(GL_FRAMEBUFFER, atlas.frameBufferObject);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, atlas.texture, 0);
+
+  const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previous));
+
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout<<"cBlockRenderer::CreateBoardRenderTargetAtlas Frame buffer is not complete "<<status<<std::endl;
+
+    glDeleteFramebuffers(1, &atlas.frameBufferObject);
+    atlas.frameBufferObject = 0;
+    glDeleteTextures(1, &atlas.texture);
+    atlas.texture = 0;
+    return false;
+  }
+
+  return true;
+}
+
+void cBlockRenderer::DestroyBoardRenderTargetAtlas(cBoardRenderTargetAtlas& atlas)
+{
+  if (atlas.frameBufferObject != 0) {
+    glDeleteFramebuffers(1, &atlas.frameBufferObject);
+    atlas.frameBufferObject = 0;
+  }
+
+  if (atlas.texture != 0) {
+    glDeleteTextures(1, &atlas.texture);
+    atlas.texture = 0;
+  }
+
+  atlas.textureWidth = 0;
+  atlas.textureHeight = 0;
+  atlas.rowX = 0;
+  atlas.rowY = 0;
+  atlas.rowHeight = 0;
+  atlas.rectangles.clear();
+}
+
+void cBlockRenderer::CreateBoardRenderTarget(cBoardRenderTarget& target, const cBoardRenderTargetAtlas& atlas, size_t rectangle, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize)
+{
+  assert(bufferQuadIndices != 0);
+  assert(!target.IsValid());
+  assert(atlas.IsValid());
+  assert(rectangle < atlas.rectangles.size());
+
+  target.frameBufferObject = atlas.frameBufferObject;
+  target.texture = atlas.texture;
+
+  const cBoardRenderTargetAtlas::cRectangle& r = atlas.rectangles[rectangle];
+  target.x = r.x;
+  target.y = r.y;
+  target.textureWidth = r.width;
+  target.textureHeight = r.height;
+
+  // Half a texel in from each edge so that filtering never reads the board next to this one
+  const float fAtlasWidth = float(atlas.textureWidth);
+  const float fAtlasHeight = float(atlas.textureHeight);
+  target.texCoordRect[0] = (float(r.x) + 0.5f) / fAtlasWidth;
+  target.texCoordRect[1] = (float(r.y) + 0.5f) / fAtlasHeight;
+  target.texCoordRect[2] = (float(r.width) - 1.0f) / fAtlasWidth;
+  target.texCoordRect[3] = (float(r.height) - 1.0f) / fAtlasHeight;
+
+  target.size = spitfire::math::cVec2(blockSize.x * float(board.GetWidth()), blockSize.y * float(board.GetHeight()));
+
+  // A single block the size of the board, SetBoardRenderTargetProjection draws the board the same way up as the texture coordinates of a block
+  vertices.clear();
+  PushBackBlock(vertices, 0, 0, spitfire::math::cColour(1.0f, 1.0f, 1.0f), target.size);
+
+  glGenVertexArrays(1, &target.vertexArrayObject);
+  glBindVertexArray(target.vertexArrayObject);
+
+  glGenBuffers(1, &target.bufferVertices);
+  glBindBuffer(GL_ARRAY_BUFFER, target.bufferVertices);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(cBlockVertex), &vertices[0], GL_STATIC_DRAW);
+
+  SetBlockVertexAttributes();
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferQuadIndices);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cBlockRenderer::DestroyBoardRenderTarget(cBoardRenderTarget& target)
+{
+  if (target.bufferVertices != 0) {
+    glDeleteBuffers(1, &target.bufferVertices);
+    target.bufferVertices = 0;
+  }
+
+  if (target.vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &target.vertexArrayObject);
+    target.vertexArrayObject = 0;
+  }
+
+  // The frame buffer and texture are destroyed with the atlas
+  target.frameBufferObject = 0;
+  target.texture = 0;
+}
+
+void cBlockRenderer::BeginBoardRenderTarget(const cBoardRenderTarget& target)
+{
+  assert(target.IsValid());
+
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFrameBufferObject);
+  glGetIntegerv(GL_VIEWPORT, previousViewport);
+  glGetIntegerv(GL_FRONT_FACE, &previousFrontFace);
+  bIsPreviousScissorTestEnabled = (glIsEnabled(GL_SCISSOR_TEST) == GL_TRUE);
+
+  glBindFramebuffer(GL_FRAMEBUFFER, target.frameBufferObject);
+  glViewport(GLint(target.x), GLint(target.y), GLsizei(target.textureWidth), GLsizei(target.textureHeight));
+  if (bIsPreviousScissorTestEnabled) glDisable(GL_SCISSOR_TEST);
+
+  // The projection of the target is flipped vertically which reverses the winding of every triangle
+  glFrontFace((previousFrontFace == GL_CCW) ? GL_CW : GL_CCW);
+
+  // The background of the board covers the whole target so there is no need to clear it
+}
+
+void cBlockRenderer::EndBoardRenderTarget(const cBoardRenderTarget& target)
+{
+  glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFrameBufferObject));
+  glViewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+  if (bIsPreviousScissorTestEnabled) glEnable(GL_SCISSOR_TEST);
+  glFrontFace(GLenum(previousFrontFace));
+}
+
+void cBlockRenderer::SetBoardRenderTargetProjection(const cBoardRenderTarget& target)
+{
+  // An orthographic projection with y increasing up the target, so that the texture is the same way up as the texture
+  // coordinates of a block and the quad in the render queue can be built like any other block
+  const float width = target.size.x;
+  const float height = target.size.y;
+  const GLfloat matrix[16] = {
+    2.0f / width, 0.0f, 0.0f, 0.0f,
+    0.0f, 2.0f / height, 0.0f, 0.0f,
+    0.0f, 0.0f, -1.0f, 0.0f,
+    -1.0f, -1.0f, 0.0f, 1.0f
+  };
+
+  glUniformMatrix4fv(_GetUniformLocation("matModelViewProjection"), 1, GL_FALSE, matrix);
+}
+
+size_t cBlockRenderer::Submit(cBlockRenderQueue& queue)
+{
+  // Stable so that draws with the same state are still drawn in the order they were added
+  std::stable_sort(queue.items.begin(), queue.items.end());
+
+  const GLint uniformOffset = _GetUniformLocation("offset");
+  const GLint uniformScale = _GetUniformLocation("scale");
+  const GLint uniformTexCoordRect = _GetUniformLocation("texCoordRect");
+
+  // Everything other than a render target uses the whole of its texture
+  const GLfloat wholeTexture[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+  // Board textures are always on the second unit, this is ignored by the shaders that don't have one
+  glUniform1i(_GetUniformLocation("texUnit1"), 1);
+
+  size_t nBinds = 0;
+  GLuint vertexArrayObject = 0;
+  GLuint texture = 0;
+
+  const size_t n = queue.items.size();
+  for (size_t i = 0; i < n; i++) {
+    const cBlockRenderQueue::cItem& item = queue.items[i];
+
+    if (item.vertexArrayObject != vertexArrayObject) {
+      vertexArrayObject = item.vertexArrayObject;
+      glBindVertexArray(vertexArrayObject);
+      nBinds++;
+    }
+
+    glUniform2f(uniformOffset, item.position.x, item.position.y);
+    glUniform1f(uniformScale, item.fScale);
+    glUniform4fv(uniformTexCoordRect, 1, (item.pTexCoordRect != nullptr) ? item.pTexCoordRect : wholeTexture);
+
+    switch (item.draw) {
+      case cBlockRenderQueue::DRAW::ELEMENTS: {
+        glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_SHORT, nullptr, item.first);
+        break;
+      }
+      case cBlockRenderQueue::DRAW::MULTI_ELEMENTS: {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, item.pCount, GL_UNSIGNED_SHORT, item.pIndices, item.nDraws, item.pBaseVertex);
+        break;
+      }
+      case cBlockRenderQueue::DRAW::INSTANCED: {
+        if (item.bufferInstances != 0) {
+          glBindBuffer(GL_ARRAY_BUFFER, item.bufferInstances);
+          glVertexAttribIPointer(ATTRIBUTE_INSTANCE, 4, GL_UNSIGNED_BYTE, sizeof(cBlockInstance), (const GLvoid*)item.instancesOffset);
+        }
+
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, item.count);
+        break;
+      }
+      case cBlockRenderQueue::DRAW::BOARD_TEXTURE: {
+        // The block texture stays on the first unit
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, item.texture);
+        glActiveTexture(GL_TEXTURE0);
+
+        glDrawArrays(GL_TRIANGLE_STRIP, item.first, item.count);
+        break;
+      }
+      case cBlockRenderQueue::DRAW::RENDER_TARGET: {
+        // The boards share an atlas so this is normally only bound for the first one
+        if (item.texture != texture) {
+          texture = item.texture;
+          glBindTexture(GL_TEXTURE_2D, texture);
+          nBinds++;
+        }
+
+        glDrawElementsBaseVertex(GL_TRIANGLES, item.count, GL_UNSIGNED_SHORT, nullptr, item.first);
+        break;
+      }
+    }
+  }
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  glActiveTexture(GL_TEXTURE0);
+
+  if (texture != 0) glBindTexture(GL_TEXTURE_2D, 0);
+
+  queue.Clear();
+
+  return nBinds;
+}
+
+
+// ** BenchmarkBlockGeometry
+
+int BenchmarkBlockGeometry()
+{
+  const size_t width = 10;
+  const size_t height = 20;
+  const size_t nColours = 8;
+  const size_t nIterations = 20000;
+  const spitfire::math::cVec2 blockSize(0.015f, 0.015f);
+
+  std::vector<spitfire::math::cColour> colours;
+  colours.push_back(spitfire::math::cColour(0.0f, 0.0f, 0.0f));
+  for (size_t i = 1; i < nColours; i++) colours.push_back(spitfire::math::cColour(float(rand() % 256) / 255.0f, float(rand() % 256) / 255.0f, float(rand() % 256) / 255.0f));
+
+  // A full board with a few holes so that both paths have to skip some cells
+  std::vector<uint8_t> board(width * height);
+  for (size_t i = 0; i < board.size(); i++) board[i] = uint8_t(((rand() % 8) == 0) ? 0 : (1 + (rand() % (nColours - 1))));
+
+  cBlockQuadEmitter emitter;
+  emitter.Create(width, blockSize);
+  for (size_t i = 0; i < nColours; i++) emitter.SetColour(i, colours[i]);
+
+  std::vector<uint8_t> cells(emitter.GetPaddedWidth(), 0);
+  std::vector<cBlockVertex> emitted(VERTICES_PER_BLOCK * width * height);
+  std::vector<cBlockVertex> pushed;
+  pushed.reserve(emitted.size());
+
+  size_t nEmitted = 0;
+  size_t nPushed = 0;
+
+  const std::chrono::steady_clock::time_point emitterStart = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < nIterations; i++) {
+    nEmitted = 0;
+    for (size_t y = 0; y < height; y++) {
+      std::memcpy(&cells[0], &board[y * width], width);
+      nEmitted += emitter.EmitRow(&cells[0], y, &emitted[nEmitted]);
+    }
+  }
+  const std::chrono::steady_clock::time_point emitterEnd = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < nIterations; i++) {
+    pushed.clear();
+    for (size_t y = 0; y < height; y++) {
+      for (size_t x = 0; x < width; x++) {
+        const uint8_t c = board[(y * width) + x];
+        if (c != 0) PushBackBlock(pushed, x, y, colours[c], blockSize);
+      }
+    }
+    nPushed = pushed.size();
+  }
+  const std::chrono::steady_clock::time_point pushBackEnd = std::chrono::steady_clock::now();
+
+  if ((nEmitted != nPushed) || (std::memcmp(&emitted[0], &pushed[0], nPushed * sizeof(cBlockVertex)) != 0)) {
+    std::cout<<"BenchmarkBlockGeometry The vertices built by cBlockQuadEmitter do not match PushBackBlock"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const double fEmitterSeconds = std::chrono::duration<double>(emitterEnd - emitterStart).count();
+  const double fPushBackSeconds = std::chrono::duration<double>(pushBackEnd - emitterEnd).count();
+  const double fVertices = double(nIterations * nEmitted);
+
+  std::cout<<"BenchmarkBlockGeometry "<<nIterations<<" boards of "<<nEmitted<<" vertices"<<std::endl;
+  #ifdef TETRIS_SSE2
+  std::cout<<"  cBlockQuadEmitter (SSE2): "<<(fVertices / fEmitterSeconds)<<" vertices per second"<<std::endl;
+  #else
+  std::cout<<"  cBlockQuadEmitter: "<<(fVertices / fEmitterSeconds)<<" vertices per second"<<std::endl;
+  #endif
+  std::cout<<"  PushBackBlock: "<<(fVertices / fPushBackSeconds)<<" vertices per second"<<std::endl;
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,520 @@
+#ifndef TETRIS_BLOCKRENDERER_H
+#define TETRIS_BLOCKRENDERER_H
+
+// Standard headers
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// OpenGL headers
+#include <GL/GLee.h>
+
+// Spitfire headers
+#include <spitfire/math/cVec2.h>
+
+// Tetris headers
+#include "tetris.h"
+
+// ** Block rendering
+//
+// Everything that puts blocks on the screen.  There are three ways to draw a board, picked with BLOCK_RENDERER:
+// - GEOMETRY builds indexed quads, four vertices per block, a row at a time and only for the rows that have changed
+// - INSTANCED draws instances of a single unit quad, each block is 4 bytes, its cell and colour index, and the shader
+//   looks up the colour and works out the corners
+// - TEXTURE uploads the board as a texture of colour indices and draws it as one quad
+//
+// Whichever way is used, each board is drawn into its own rectangle of a shared render target atlas only when it changes,
+// and then the cached boards and the pieces are sorted into a render queue so a frame is a handful of draws.  Pieces are
+// drawn from a mesh cache built up front, and anything that is rewritten every frame goes through a streaming buffer.
+
+enum class BLOCK_RENDERER {
+  GEOMETRY,
+  INSTANCED,
+  TEXTURE, // Boards are textures, pieces are instanced
+};
+
+BLOCK_RENDERER GetBlockRendererFromName(const spitfire::string_t& sName);
+
+// ** cStreamingBuffer
+//
+// A buffer that is allocated once at its largest size and then rewritten over and over.  Each write goes to the next of
+// a few segments so that we never write to data that the GPU may still be drawing from, when we wrap around to the
+// first segment the storage is orphaned so that the driver can give us fresh memory instead of waiting.
+
+class cStreamingBuffer
+{
+public:
+  cStreamingBuffer();
+
+  bool IsValid() const { return (buffer != 0); }
+  GLuint GetBuffer() const { return buffer; }
+
+  void Create(size_t nMaxBytes);
+  void Destroy();
+
+  // Returns the offset in bytes that the data was written to, leaves the buffer bound to GL_ARRAY_BUFFER
+  size_t Write(const void* pData, size_t nBytes);
+
+private:
+  static const size_t SEGMENTS = 3;
+
+  GLuint buffer;
+  size_t nSegmentBytes;
+  size_t iSegment;
+};
+
+struct cBlockInstance
+{
+  uint8_t x;
+  uint8_t y;
+  uint8_t colour;
+  uint8_t unused;
+};
+
+class cBlockInstanceBuffer
+{
+public:
+  cBlockInstanceBuffer();
+
+  bool IsValid() const { return (vertexArrayObject != 0); }
+  size_t GetInstanceCount() const { return nInstances; }
+
+private:
+  GLuint vertexArrayObject;
+  cStreamingBuffer instances;
+
+  size_t nMaxInstances;
+  size_t nInstances;
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// ** Board geometry
+//
+// The geometry renderer uses four 12 byte vertices per block, a position and a packed colour, with the two triangles
+// taken from an index buffer shared by all geometry and the texture coordinates worked out in blockgeometry.vert.
+// Every row of the board has a fixed slot in one buffer.  Only the occupied cells of a row are written to the start of
+// its slot and each row is drawn with its own count and base vertex, so after a change only the rows whose revision has
+// changed are rebuilt and uploaded.
+
+struct cBlockVertex
+{
+  GLfloat x;
+  GLfloat y;
+  GLubyte r;
+  GLubyte g;
+  GLubyte b;
+  GLubyte a;
+};
+
+// ** cBlockQuadEmitter
+//
+// Writes the vertices of every occupied cell of a row straight into a buffer that is already big enough.  The corners
+// of each column are worked out once up front, so each block is three SIMD adds, ors and stores instead of building
+// each of its vertices separately, and the occupied cells are found 16 at a time.
+
+class cBlockQuadEmitter
+{
+public:
+  cBlockQuadEmitter();
+
+  void Create(size_t width, const spitfire::math::cVec2& blockSize);
+  bool IsCreatedFor(size_t _width, const spitfire::math::cVec2& blockSize) const { return ((_width == width) && (blockSize.x == fBlockWidth) && (blockSize.y == fBlockHeight)); }
+
+  void SetColour(size_t i, const spitfire::math::cColour& colour);
+  void SetColours(const tetris::cBoardSnapshot& board);
+
+  // Rows of cells are read 16 at a time so they must be this long, with zeros after the last cell
+  size_t GetPaddedWidth() const { return paddedWidth; }
+
+  // pVertices must have room for a block in every cell, returns the number of vertices written
+  size_t EmitRow(const uint8_t* pCells, size_t y, cBlockVertex* pVertices) const;
+
+private:
+  // The parts of the three 16 byte stores of a block that come from the column, the row and the colour
+  struct cColumn
+  {
+    GLfloat a[4];
+    GLfloat b[4];
+    GLfloat c[4];
+  };
+
+  size_t width;
+  size_t paddedWidth;
+  float fBlockWidth;
+  float fBlockHeight;
+
+  std::vector<cColumn> columns;
+  uint32_t colours[256]; // Packed the same as the colour of a vertex and indexed by the value of a cell
+};
+
+class cBoardGeometryBuffer
+{
+public:
+  cBoardGeometryBuffer();
+
+  bool IsValid() const { return (vertexArrayObject != 0); }
+
+private:
+  GLuint vertexArrayObject;
+  GLuint bufferVertices;
+
+  size_t width;
+  size_t height;
+
+  std::vector<GLint> rowBaseVertex;
+  std::vector<GLsizei> rowCount; // Indices
+  std::vector<const GLvoid*> rowIndices; // Every row uses the start of the shared indices
+  std::vector<uint64_t> rowRevisions; // The revision of each row that is in the buffer
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// A rectangle with the block texture that isn't lined up with the blocks of a board, such as the flash of a line clearing
+class cBlockQuad
+{
+public:
+  spitfire::math::cVec2 position;
+  spitfire::math::cVec2 size;
+  spitfire::math::cColour colour;
+};
+
+class cPieceGeometryBuffer
+{
+public:
+  cPieceGeometryBuffer();
+
+  bool IsValid() const { return (vertexArrayObject != 0); }
+
+private:
+  GLuint vertexArrayObject;
+  cStreamingBuffer vertices;
+
+  size_t nMaxVertices;
+  GLint first; // Base vertex
+  GLsizei count; // Indices
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// ** Board textures
+//
+// Each cell of the board is one texel of a texture of colour indices and the whole board is drawn as a single quad,
+// blockboard.frag looks up the colour of each cell.  After a change only the rows that have changed are uploaded, which
+// is a few bytes instead of rebuilding any geometry.
+
+class cBoardTexture
+{
+public:
+  cBoardTexture();
+
+  bool IsValid() const { return (texture != 0); }
+
+private:
+  GLuint vertexArrayObject;
+  GLuint texture;
+
+  size_t width;
+  size_t height;
+
+  std::vector<uint64_t> rowRevisions; // The revision of each row that is in the texture
+  std::vector<uint8_t> texels; // Reused for each upload
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// ** cBoardRenderTargetAtlas
+//
+// One texture that the render targets of all the boards are packed into, so that every board is drawn without changing
+// texture.  The rectangles are added up front, placed left to right in rows in the order they are added, and then the
+// texture is created big enough to hold them all.
+
+class cBoardRenderTargetAtlas
+{
+public:
+  cBoardRenderTargetAtlas();
+
+  bool IsValid() const { return (frameBufferObject != 0); }
+
+  // Returns the index of the rectangle for CreateBoardRenderTarget, the texture must not have been created yet
+  size_t Add(size_t width, size_t height);
+
+private:
+  struct cRectangle
+  {
+    size_t x;
+    size_t y;
+    size_t width;
+    size_t height;
+  };
+
+  GLuint frameBufferObject;
+  GLuint texture;
+
+  size_t textureWidth;
+  size_t textureHeight;
+
+  // Where the next rectangle goes
+  size_t rowX;
+  size_t rowY;
+  size_t rowHeight;
+
+  std::vector<cRectangle> rectangles;
+
+  friend class cBlockRenderer;
+};
+
+// ** cBoardRenderTarget
+//
+// An offscreen copy of a board that is only redrawn when the board changes, every other frame the board is one textured
+// quad drawn with blockgeometry.vert.  The copy is a rectangle of a cBoardRenderTargetAtlas.
+
+class cBoardRenderTarget
+{
+public:
+  cBoardRenderTarget();
+
+  bool IsValid() const { return (frameBufferObject != 0); }
+
+private:
+  // Owned by the atlas
+  GLuint frameBufferObject;
+  GLuint texture;
+
+  GLuint vertexArrayObject;
+  GLuint bufferVertices;
+
+  // The rectangle of the atlas in texels and in texture coordinates (x, y, width, height)
+  size_t x;
+  size_t y;
+  size_t textureWidth;
+  size_t textureHeight;
+  GLfloat texCoordRect[4];
+
+  spitfire::math::cVec2 size; // The size of the board on the screen
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// ** cPieceMeshCache
+//
+// Every piece that can be played, in each of its four orientations, is built once at the start of a game into a single
+// static buffer.  Changing or rotating a piece then only selects which range of the buffer to draw.
+
+struct cPieceMeshRange
+{
+  cPieceMeshRange() : first(0), count(0) {}
+
+  bool IsValid() const { return (count != 0); }
+
+  GLint first;   // Base vertex or first instance
+  GLsizei count; // Number of indices or instances
+};
+
+class cPieceMeshCache
+{
+public:
+  cPieceMeshCache();
+
+  bool IsValid() const { return (vertexArrayObject != 0); }
+
+  // Returns an invalid range if this piece is not in the cache
+  cPieceMeshRange Find(const tetris::cPiece& piece) const;
+
+private:
+  static uint64_t _GetKey(const tetris::cPiece& piece);
+
+  BLOCK_RENDERER mode;
+
+  GLuint vertexArrayObject;
+  GLuint buffer;
+
+  std::map<uint64_t, cPieceMeshRange> ranges; // Keyed on the hash of the blocks, which includes their colours
+
+  friend class cBlockRenderer;
+  friend class cBlockRenderQueue;
+};
+
+// ** cBlockRenderQueue
+//
+// Gathers every block draw for a frame so that they can be submitted together.  Draws are sorted by layer and then by
+// vertex array, the position and scale of each draw are sent as uniforms so the shader, texture and matrices are only
+// set once.
+
+enum class BLOCK_LAYER {
+  BACKGROUND, // Empty cells
+  BLOCKS,     // Boards and pieces, these never overlap each other
+};
+
+class cBlockRenderQueue
+{
+public:
+  void Clear() { items.clear(); }
+  bool IsEmpty() const { return items.empty(); }
+
+  void AddBoardGeometry(const cBoardGeometryBuffer& buffer, const spitfire::math::cVec2& position);
+  void AddPieceGeometry(const cPieceGeometryBuffer& buffer, const spitfire::math::cVec2& position);
+  void AddInstances(BLOCK_LAYER layer, const cBlockInstanceBuffer& buffer, const spitfire::math::cVec2& position);
+  void AddPieceMesh(const cPieceMeshCache& cache, const cPieceMeshRange& range, const spitfire::math::cVec2& position);
+  void AddBoardTexture(const cBoardTexture& texture, const spitfire::math::cVec2& position);
+  void AddBoardRenderTarget(const cBoardRenderTarget& target, const spitfire::math::cVec2& position, float fScale);
+
+private:
+  enum class DRAW {
+    ELEMENTS,
+    MULTI_ELEMENTS,
+    INSTANCED,
+    BOARD_TEXTURE,
+    RENDER_TARGET,
+  };
+
+  struct cItem
+  {
+    bool operator<(const cItem& rhs) const { return (key < rhs.key); }
+
+    uint64_t key; // Layer then vertex array
+
+    GLuint vertexArrayObject;
+    DRAW draw;
+
+    GLint first; // Base vertex for ELEMENTS
+    GLsizei count;
+
+    // Rows of the board for MULTI_ELEMENTS
+    const GLint* pBaseVertex;
+    const GLsizei* pCount;
+    const GLvoid* const* pIndices;
+    GLsizei nDraws;
+
+    // Instanced draws from a range of a static buffer point the instance attribute at their first instance
+    GLuint bufferInstances;
+    size_t instancesOffset;
+
+    GLuint texture; // On the second unit for BOARD_TEXTURE and the first unit for RENDER_TARGET
+    const GLfloat* pTexCoordRect; // The rectangle of the atlas for RENDER_TARGET
+
+    spitfire::math::cVec2 position;
+    float fScale;
+  };
+
+  void _Add(BLOCK_LAYER layer, GLuint vertexArrayObject, DRAW draw, GLint first, GLsizei count, const spitfire::math::cVec2& position);
+
+  std::vector<cItem> items;
+
+  friend class cBlockRenderer;
+};
+
+class cBlockRenderer
+{
+public:
+  static const size_t MAX_COLOURS = 16;
+  static const size_t MAX_PIECE_BLOCKS = 16;
+  static const size_t MAX_INDEXED_BLOCKS = 1024; // The most blocks in one draw of geometry, the background of a board is the largest
+
+  cBlockRenderer();
+  ~cBlockRenderer();
+
+  void Create();
+  void Destroy();
+
+  // The buffer is allocated once at its maximum size and then only ever updated
+  void CreateInstanceBuffer(cBlockInstanceBuffer& buffer, size_t nMaxInstances);
+  void DestroyInstanceBuffer(cBlockInstanceBuffer& buffer);
+
+  // Replaces the contents of the buffer with a single upload
+  void SetInstances(cBlockInstanceBuffer& buffer, const std::vector<cBlockInstance>& instances);
+
+  // These apply to the currently bound shader which must be blockinstanced.vert
+  void SetBlockSize(const spitfire::math::cVec2& blockSize);
+  void SetColours(const tetris::cBoardSnapshot& board);
+
+  // Empty cells are skipped, the background is drawn from a separate buffer that is only built once
+  static void BuildBoardInstances(const tetris::cBoardSnapshot& board, std::vector<cBlockInstance>& instances);
+  static void BuildBackgroundInstances(const tetris::cBoardSnapshot& board, std::vector<cBlockInstance>& instances);
+  static void BuildPieceInstances(const tetris::cPiece& piece, std::vector<cBlockInstance>& instances);
+
+  // The empty cells are kept at the end of the same buffer and are drawn underneath the board
+  void CreateBoardGeometryBuffer(cBoardGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+  void DestroyBoardGeometryBuffer(cBoardGeometryBuffer& buffer);
+
+  // Returns the number of rows that were uploaded
+  size_t UpdateBoardGeometry(cBoardGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+
+  void CreatePieceGeometryBuffer(cPieceGeometryBuffer& buffer, size_t nMaxBlocks);
+  void DestroyPieceGeometryBuffer(cPieceGeometryBuffer& buffer);
+  void UpdatePieceGeometry(cPieceGeometryBuffer& buffer, const tetris::cBoardSnapshot& board, const tetris::cPiece& piece, const spitfire::math::cVec2& blockSize);
+
+  // Quads past the capacity of the buffer are left out
+  void UpdateQuadGeometry(cPieceGeometryBuffer& buffer, const std::vector<cBlockQuad>& quads);
+
+  // Geometry caches have the colours of the board built in
+  void CreatePieceMeshCache(cPieceMeshCache& cache, BLOCK_RENDERER mode, const std::vector<tetris::cPiece>& pieces, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+  void DestroyPieceMeshCache(cPieceMeshCache& cache);
+
+  // The board texture is drawn with blockboard.vert, the background is included so there is nothing else to draw
+  void CreateBoardTexture(cBoardTexture& texture, const tetris::cBoardSnapshot& board);
+  void DestroyBoardTexture(cBoardTexture& texture);
+
+  // Returns the number of rows that were uploaded
+  size_t UpdateBoardTexture(cBoardTexture& texture, const tetris::cBoardSnapshot& board);
+
+  // Creates the texture for all of the rectangles that have been added to the atlas, returns false if the texture would be
+  // bigger than the driver supports or the frame buffer can't be drawn to, the atlas is left without a texture
+  bool CreateBoardRenderTargetAtlas(cBoardRenderTargetAtlas& atlas);
+  void DestroyBoardRenderTargetAtlas(cBoardRenderTargetAtlas& atlas);
+
+  void CreateBoardRenderTarget(cBoardRenderTarget& target, const cBoardRenderTargetAtlas& atlas, size_t rectangle, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+  void DestroyBoardRenderTarget(cBoardRenderTarget& target);
+
+  // Everything drawn in between is drawn into the render target with the board at the origin, the previous frame buffer
+  // and viewport are restored afterwards so this can be done part way through rendering another target
+  void BeginBoardRenderTarget(const cBoardRenderTarget& target);
+  void EndBoardRenderTarget(const cBoardRenderTarget& target);
+
+  // For the currently bound shader, maps the board at the origin on to the render target
+  void SetBoardRenderTargetProjection(const cBoardRenderTarget& target);
+
+  // Sorts the queue and draws everything in it with the currently bound shader, blockgeometry.vert for geometry,
+  // blockinstanced.vert for instances and blockboard.vert for board textures.  Returns the number of vertex arrays and
+  // textures that were bound.
+  size_t Submit(cBlockRenderQueue& queue);
+
+private:
+  GLint _GetUniformLocation(const char* szName) const;
+
+  // Sets up the emitter and clears the cells for building rows that are this wide
+  void _BeginRows(size_t width, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+
+  // Appends the blocks of the cells to the vertices
+  void _AppendRow(size_t y);
+
+  // Appends the blocks of the piece to the vertices, upside down so that the first row of the piece is at the top
+  void _AppendPiece(const tetris::cPiece& piece, const tetris::cBoardSnapshot& board, const spitfire::math::cVec2& blockSize);
+
+  // Writes the vertices to the next segment of the buffer
+  void _UploadPieceGeometry(cPieceGeometryBuffer& buffer);
+
+  GLuint bufferQuad;
+  GLuint bufferQuadIndices; // Two triangles for every block of geometry
+
+  // Restored at the end of drawing to a board render target
+  GLint previousFrameBufferObject;
+  GLint previousViewport[4];
+  GLint previousFrontFace;
+  bool bIsPreviousScissorTestEnabled; // The screen may be letter boxed with a scissor rectangle
+
+  std::vector<cBlockVertex> vertices; // Reused for each row that is built
+  std::vector<uint8_t> cells; // Reused for each row that is built, padded for cBlockQuadEmitter
+  cBlockQuadEmitter emitter;
+};
+
+// Times building every row of a full board with cBlockQuadEmitter and one vertex at a time and prints the vertices per
+// second, returns an exit code for main
+int BenchmarkBlockGeometry();
+
+#endif // TETRIS_BLOCKRENDERER_H
@@ -0,0 +1,95 @@
+// Standard headers
+#include <cassert>
+
+#include <iostream>
+
+#include <algorithm>
+#include <vector>
+
+// Tetris headers
+#include "boardlayout.h"
+
+namespace
+{
+  // The low detail boards have no next piece so they only need a small gap around them
+  const float SPACING = 0.1f;
+
+  // The scale of the low detail boards when there is no room left next to the full detail boards
+  const float MIN_SCALE = 0.1f;
+}
+
+// ** cBoardLayoutItem
+
+cBoardLayoutItem::cBoardLayoutItem() :
+  fScale(1.0f),
+  detail(BOARD_DETAIL::FULL)
+{
+}
+
+
+// ** LayoutBoards
+
+void LayoutBoards(size_t nBoards, size_t nFullDetail, const spitfire::math::cVec2& areaPosition, const spitfire::math::cVec2& areaSize, const spitfire::math::cVec2& boardSize, float fFullDetailWidth, std::vector<cBoardLayoutItem>& layout)
+{
+  assert(boardSize.x > 0.0f);
+  assert(boardSize.y > 0.0f);
+
+  layout.assign(nBoards, cBoardLayoutItem());
+
+  nFullDetail = std::min(nFullDetail, nBoards);
+
+  // The full detail boards are drawn side by side at their original size
+  for (size_t i = 0; i < nFullDetail; i++) {
+    layout[i].position = spitfire::math::cVec2(areaPosition.x + (float(i) * fFullDetailWidth), areaPosition.y);
+  }
+
+  const size_t nLowDetail = nBoards - nFullDetail;
+  if (nLowDetail == 0) return;
+
+  const float fCellWidth = boardSize.x * (1.0f + SPACING);
+  const float fCellHeight = boardSize.y * (1.0f + SPACING);
+
+  float fGridLeft = areaPosition.x + (float(nFullDetail) * fFullDetailWidth);
+  float fGridTop = areaPosition.y;
+  const float fGridWidth = (areaPosition.x + areaSize.x) - fGridLeft;
+  const float fGridHeight = areaSize.y;
+
+  size_t columns = 1;
+  float fScale = 0.0f;
+
+  if ((fGridWidth <= 0.0f) || (fGridHeight <= 0.0f)) {
+    static bool bIsNoRoomLogged = false;
+    if (!bIsNoRoomLogged) {
+      std::cout<<"LayoutBoards There is no room left for "<<nLowDetail<<" boards, drawing them underneath the other boards"<<std::endl;
+      bIsNoRoomLogged = true;
+    }
+
+    // Rows of the smallest boards across the whole area underneath the full detail boards
+    fGridLeft = areaPosition.x;
+    fGridTop = areaPosition.y + (boardSize.y * (1.0f + SPACING));
+    fScale = MIN_SCALE;
+    columns = std::max<size_t>(1, size_t(areaSize.x / (fCellWidth * fScale)));
+  } else {
+    // Find the number of columns that gives the largest boards
+    for (size_t c = 1; c <= nLowDetail; c++) {
+      const size_t r = (nLowDetail + c - 1) / c;
+      const float fScaleForColumns = std::min(fGridWidth / (float(c) * fCellWidth), fGridHeight / (float(r) * fCellHeight));
+      if (fScaleForColumns > fScale) {
+        columns = c;
+        fScale = fScaleForColumns;
+      }
+    }
+
+    // Never draw a low detail board bigger than a full detail board
+    fScale = std::min(fScale, 1.0f);
+  }
+
+  for (size_t i = 0; i < nLowDetail; i++) {
+    cBoardLayoutItem& item = layout[nFullDetail + i];
+    const size_t column = i % columns;
+    const size_t row = i / columns;
+    item.position = spitfire::math::cVec2(fGridLeft + (float(column) * fCellWidth * fScale), fGridTop + (float(row) * fCellHeight * fScale));
+    item.fScale = fScale;
+    item.detail = BOARD_DETAIL::LOW;
+  }
+}
@@ -0,0 +1,35 @@
+#ifndef TETRIS_BOARDLAYOUT_H
+#define TETRIS_BOARDLAYOUT_H
+
+// Standard headers
+#include <cstddef>
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/math/cVec2.h>
+
+// ** Board layout
+//
+// The boards of the local players are drawn side by side at full size with their next pieces, any other boards are
+// shrunk down to fit in a grid in the space that is left over and are drawn at a lower level of detail.
+
+enum class BOARD_DETAIL {
+  FULL, // Drawn every frame with the next piece
+  LOW,  // Drawn from a small render target that includes the current piece and is only updated every few frames
+};
+
+class cBoardLayoutItem
+{
+public:
+  cBoardLayoutItem();
+
+  spitfire::math::cVec2 position;
+  float fScale;
+  BOARD_DETAIL detail;
+};
+
+// Everything is in the units of the 2D render mode, fFullDetailWidth is the width of a full detail board including its
+// next piece and the gap to the next board
+void LayoutBoards(size_t nBoards, size_t nFullDetail, const spitfire::math::cVec2& areaPosition, const spitfire::math::cVec2& areaSize, const spitfire::math::cVec2& boardSize, float fFullDetailWidth, std::vector<cBoardLayoutItem>& layout);
+
+#endif // TETRIS_BOARDLAYOUT_H
@@ -0,0 +1,155 @@
+// Standard headers
+#include <cassert>
+
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include <map>
+#include <vector>
+
+// Tetris headers
+#include "desync.h"
+
+namespace tetris
+{
+  // ** cDesyncChecker
+
+  cDesyncChecker::cDesyncChecker() :
+    bIsDesynced(false),
+    desyncedTick(0)
+  {
+  }
+
+  void cDesyncChecker::Clear()
+  {
+    localTicks.clear();
+    remoteTicks.clear();
+
+    bIsDesynced = false;
+    desyncedTick = 0;
+    sReport.clear();
+  }
+
+  void cDesyncChecker::GetStateHashes(const cGame& game, std::vector<uint64_t>& hashes)
+  {
+    hashes.clear();
+
+    const size_t n = game.boards.size();
+    for (size_t i = 0; i < n; i++) hashes.push_back(game.boards[i]->GetStateHash());
+  }
+
+  std::string cDesyncChecker::GetStateDump(const cGame& game)
+  {
+    std::ostringstream o;
+
+    o<<"tick "<<game.GetTick()<<std::endl;
+
+    const size_t n = game.boards.size();
+    for (size_t i = 0; i < n; i++) {
+      const cBoard& board = *(game.boards[i]);
+      o<<"board "<<i<<" hash "<<std::hex<<board.GetStateHash()<<std::dec<<std::endl;
+      board.DumpState(o);
+    }
+
+    return o.str();
+  }
+
+  void cDesyncChecker::_SetDesynced(uint64_t tick, const std::string& _sReport)
+  {
+    // Only the first desync is interesting, everything after it is just fallout
+    if (bIsDesynced) return;
+
+    bIsDesynced = true;
+    desyncedTick = tick;
+    sReport = _sReport;
+
+    std::cout<<"cDesyncChecker::_SetDesynced Desync at tick "<<tick<<std::endl<<sReport<<std::endl;
+  }
+
+  void cDesyncChecker::CompareReplicas(const cGame& lhs, const cGame& rhs)
+  {
+    if (bIsDesynced) return;
+
+    assert(lhs.GetTick() == rhs.GetTick());
+
+    std::vector<uint64_t> hashesLhs;
+    GetStateHashes(lhs, hashesLhs);
+    std::vector<uint64_t> hashesRhs;
+    GetStateHashes(rhs, hashesRhs);
+
+    if (hashesLhs != hashesRhs) {
+      std::ostringstream o;
+      o<<"Replica A"<<std::endl<<GetStateDump(lhs)<<std::endl;
+      o<<"Replica B"<<std::endl<<GetStateDump(rhs);
+      _SetDesynced(lhs.GetTick(), o.str());
+    }
+  }
+
+  void cDesyncChecker::AddLocalTick(const cGame& game)
+  {
+    if (bIsDesynced) return;
+
+    const uint64_t tick = game.GetTick();
+
+    cLocalTick& localTick = localTicks[tick];
+    GetStateHashes(game, localTick.hashes);
+    localTick.sDump = GetStateDump(game);
+
+    _CompareLocalAndRemote(tick);
+
+    _RemoveOldTicks(tick);
+  }
+
+  bool cDesyncChecker::GetLocalTick(uint64_t tick, std::vector<uint64_t>& hashes) const
+  {
+    std::map<uint64_t, cLocalTick>::const_iterator iter = localTicks.find(tick);
+    if (iter == localTicks.end()) return false;
+
+    hashes = iter->second.hashes;
+    return true;
+  }
+
+  void cDesyncChecker::AddRemoteTick(uint64_t tick, const std::vector<uint64_t>& hashes)
+  {
+    if (bIsDesynced) return;
+
+    remoteTicks[tick] = hashes;
+
+    _CompareLocalAndRemote(tick);
+  }
+
+  void cDesyncChecker::_CompareLocalAndRemote(uint64_t tick)
+  {
+    std::map<uint64_t, cLocalTick>::iterator iterLocal = localTicks.find(tick);
+    if (iterLocal == localTicks.end()) return;
+
+    std::map<uint64_t, std::vector<uint64_t> >::iterator iterRemote = remoteTicks.find(tick);
+    if (iterRemote == remoteTicks.end()) return;
+
+    const std::vector<uint64_t>& hashesLocal = iterLocal->second.hashes;
+    const std::vector<uint64_t>& hashesRemote = iterRemote->second;
+    if (hashesLocal != hashesRemote) {
+      // We only have the remote hashes, the remote participant has to be asked for its own dump of this tick
+      std::ostringstream o;
+      o<<"Local"<<std::endl<<iterLocal->second.sDump<<std::endl;
+      o<<"Remote"<<std::endl;
+      const size_t n = hashesRemote.size();
+      for (size_t i = 0; i < n; i++) o<<"board "<<i<<" hash "<<std::hex<<hashesRemote[i]<<std::dec<<std::endl;
+      _SetDesynced(tick, o.str());
+    }
+
+    // This tick has been checked, we don't need it any more
+    localTicks.erase(iterLocal);
+    remoteTicks.erase(iterRemote);
+  }
+
+  void cDesyncChecker::_RemoveOldTicks(uint64_t tick)
+  {
+    if (tick < nMaxHistoryTicks) return;
+
+    const uint64_t oldest = tick - nMaxHistoryTicks;
+    localTicks.erase(localTicks.begin(), localTicks.lower_bound(oldest));
+    remoteTicks.erase(remoteTicks.begin(), remoteTicks.lower_bound(oldest));
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef TETRIS_DESYNC_H
+#define TETRIS_DESYNC_H
+
+// Standard headers
+#include <map>
+#include <string>
+#include <vector>
+
+// Tetris headers
+#include "tetris.h"
+
+namespace tetris
+{
+  // ** cDesyncChecker
+  //
+  // Compares the per tick state hashes of every board in two replicas of the same game.  The replicas can either be two
+  // cGame objects in this process (CompareReplicas), or the local game and the hashes sent by a remote participant
+  // (AddLocalTick and AddRemoteTick).  The first tick where any board differs is reported along with a dump of the states.
+
+  class cDesyncChecker
+  {
+  public:
+    cDesyncChecker();
+
+    void Clear();
+
+    bool IsDesynced() const { return bIsDesynced; }
+    uint64_t GetDesyncedTick() const { return desyncedTick; }
+    const std::string& GetReport() const { return sReport; }
+
+    static void GetStateHashes(const cGame& game, std::vector<uint64_t>& hashes);
+    static std::string GetStateDump(const cGame& game);
+
+    // In process replicas, both games must have been updated to the same tick
+    void CompareReplicas(const cGame& lhs, const cGame& rhs);
+
+    // Networked replicas, the hashes for a local tick can be retrieved with GetLocalTick and sent to the other participants
+    void AddLocalTick(const cGame& game);
+    bool GetLocalTick(uint64_t tick, std::vector<uint64_t>& hashes) const;
+    void AddRemoteTick(uint64_t tick, const std::vector<uint64_t>& hashes);
+
+  private:
+    void _CompareLocalAndRemote(uint64_t tick);
+    void _SetDesynced(uint64_t tick, const std::string& sReport);
+    void _RemoveOldTicks(uint64_t tick);
+
+    // We only keep a limited history, a remote participant that is further behind than this cannot be checked
+    static const uint64_t nMaxHistoryTicks = 256;
+
+    struct cLocalTick
+    {
+      std::vector<uint64_t> hashes;
+      std::string sDump;
+    };
+
+    std::map<uint64_t, cLocalTick> localTicks;
+    std::map<uint64_t, std::vector<uint64_t> > remoteTicks;
+
+    bool bIsDesynced;
+    uint64_t desyncedTick;
+    std::string sReport;
+  };
+}
+
+#endif // TETRIS_DESYNC_H
@@ -0,0 +1,94 @@
+// Standard headers
+#include <cassert>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Tetris headers
+#include "framepacer.h"
+
+namespace
+{
+  const size_t DEFAULT_FRAMES_PER_SECOND = 60;
+}
+
+// ** cFramePacer
+
+const std::chrono::microseconds cFramePacer::spinDuration(2000);
+const std::chrono::microseconds cFramePacer::maxFrameDuration(100000);
+
+cFramePacer::cFramePacer() :
+  framesPerSecond(0),
+  period(clock::duration::zero()),
+  bIsStarted(false),
+  iSample(0),
+  nSamplesUsed(0),
+  total(clock::duration::zero())
+{
+  for (size_t i = 0; i < nSamples; i++) samples[i] = clock::duration::zero();
+}
+
+void cFramePacer::SetTargetFramesPerSecond(size_t _framesPerSecond)
+{
+  framesPerSecond = _framesPerSecond;
+  period = clock::duration::zero();
+  if (framesPerSecond != 0) period = std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) / framesPerSecond;
+
+  // Start again from the next frame at the new rate
+  bIsStarted = false;
+}
+
+void cFramePacer::Reset()
+{
+  bIsStarted = false;
+
+  for (size_t i = 0; i < nSamples; i++) samples[i] = clock::duration::zero();
+  iSample = 0;
+  nSamplesUsed = 0;
+  total = clock::duration::zero();
+}
+
+void cFramePacer::WaitForNextFrame()
+{
+  if (!bIsStarted) {
+    bIsStarted = true;
+    previousFrameEnd = clock::now();
+    deadline = previousFrameEnd + period;
+    return;
+  }
+
+  if (framesPerSecond != 0) {
+    // Sleep through most of the wait and then spin for the last little bit
+    clock::time_point now = clock::now();
+    if ((deadline - now) > spinDuration) std::this_thread::sleep_for(deadline - now - spinDuration);
+
+    now = clock::now();
+    while (now < deadline) {
+      std::this_thread::yield();
+      now = clock::now();
+    }
+
+    // If we have fallen more than a whole frame behind we start again from now instead of rushing to catch up
+    deadline += period;
+    if (deadline < now) deadline = now + period;
+  }
+
+  const clock::time_point frameEnd = clock::now();
+  const clock::duration duration = std::min<clock::duration>(frameEnd - previousFrameEnd, maxFrameDuration);
+  previousFrameEnd = frameEnd;
+
+  // A running total over a ring of samples
+  total -= samples[iSample];
+  samples[iSample] = duration;
+  total += duration;
+  iSample = (iSample + 1) % nSamples;
+  if (nSamplesUsed < nSamples) nSamplesUsed++;
+}
+
+float cFramePacer::GetSmoothedFrameDurationMS() const
+{
+  if (nSamplesUsed == 0) return 1000.0f / float((framesPerSecond != 0) ? framesPerSecond : DEFAULT_FRAMES_PER_SECOND);
+
+  return std::chrono::duration<float, std::milli>(total).count() / float(nSamplesUsed);
+}
@@ -0,0 +1,58 @@
+#ifndef TETRIS_FRAMEPACER_H
+#define TETRIS_FRAMEPACER_H
+
+// Standard headers
+#include <chrono>
+#include <cstddef>
+
+// ** cFramePacer
+//
+// Limits the frame rate by waiting for a deadline at the end of each frame.  Sleeping is only accurate to a millisecond
+// or two so we sleep until just before the deadline and then spin for the rest of it.  The deadlines are a fixed period
+// apart rather than a period after the end of the previous frame, so a slow frame is caught up on the next one instead
+// of pushing every later frame back.  The last few frame times are averaged for animations that would otherwise shake
+// with the jitter of each frame.
+
+class cFramePacer
+{
+public:
+  typedef std::chrono::steady_clock clock;
+
+  cFramePacer();
+
+  // 0 turns the limiter off, for example when the swap is already waiting for vsync
+  void SetTargetFramesPerSecond(size_t framesPerSecond);
+  size_t GetTargetFramesPerSecond() const { return framesPerSecond; }
+
+  // Forgets the deadline and the frame times, for when frames have not been drawn for a while
+  void Reset();
+
+  // Called once at the end of each frame, waits until it is time to start the next frame
+  void WaitForNextFrame();
+
+  // The average of the last few frames, or the target frame time if there haven't been any yet
+  float GetSmoothedFrameDurationMS() const;
+
+private:
+  static const size_t nSamples = 8;
+
+  // Sleeping for less than this is too inaccurate so we spin instead
+  static const std::chrono::microseconds spinDuration;
+
+  // Longer frames are counted as this long so one stall doesn't throw the average out for the next few frames
+  static const std::chrono::microseconds maxFrameDuration;
+
+  size_t framesPerSecond;
+  clock::duration period;
+
+  bool bIsStarted;
+  clock::time_point deadline;
+  clock::time_point previousFrameEnd;
+
+  clock::duration samples[nSamples];
+  size_t iSample;
+  size_t nSamplesUsed;
+  clock::duration total;
+};
+
+#endif // TETRIS_FRAMEPACER_H
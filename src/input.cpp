@@ -0,0 +1,76 @@
+// Standard headers
+#include <cassert>
+
+#include <vector>
+
+// Tetris headers
+#include "input.h"
+
+namespace tetris
+{
+  // ** cInputMapper
+
+  cInputMapper::cInputMapper(cSimulation& _simulation) :
+    simulation(_simulation)
+  {
+  }
+
+  void cInputMapper::AddBinding(DEVICE device, size_t deviceIndex, int button, size_t board, INPUT input)
+  {
+    cBinding binding;
+    binding.device = device;
+    binding.deviceIndex = deviceIndex;
+    binding.button = button;
+    binding.board = board;
+    binding.input = input;
+    binding.bIsDown = false;
+
+    bindings.push_back(binding);
+  }
+
+  void cInputMapper::ClearBindings()
+  {
+    bindings.clear();
+  }
+
+  void cInputMapper::OnButtonDown(DEVICE device, size_t deviceIndex, int button, timepoint_t time)
+  {
+    const size_t n = bindings.size();
+    for (size_t i = 0; i < n; i++) {
+      cBinding& binding = bindings[i];
+      if ((binding.device != device) || (binding.deviceIndex != deviceIndex) || (binding.button != button)) continue;
+
+      // Key repeat events from the operating system are ignored, the simulation repeats held inputs itself
+      if (binding.bIsDown) continue;
+
+      binding.bIsDown = true;
+      simulation.QueueInputDown(binding.board, binding.input, time);
+    }
+  }
+
+  void cInputMapper::OnButtonUp(DEVICE device, size_t deviceIndex, int button, timepoint_t time)
+  {
+    const size_t n = bindings.size();
+    for (size_t i = 0; i < n; i++) {
+      cBinding& binding = bindings[i];
+      if ((binding.device != device) || (binding.deviceIndex != deviceIndex) || (binding.button != button)) continue;
+
+      if (!binding.bIsDown) continue;
+
+      binding.bIsDown = false;
+      simulation.QueueInputUp(binding.board, binding.input, time);
+    }
+  }
+
+  void cInputMapper::ReleaseAll(timepoint_t time)
+  {
+    const size_t n = bindings.size();
+    for (size_t i = 0; i < n; i++) {
+      cBinding& binding = bindings[i];
+      if (!binding.bIsDown) continue;
+
+      binding.bIsDown = false;
+      simulation.QueueInputUp(binding.board, binding.input, time);
+    }
+  }
+}
@@ -0,0 +1,54 @@
+#ifndef TETRIS_INPUT_H
+#define TETRIS_INPUT_H
+
+// Standard headers
+#include <vector>
+
+// Tetris headers
+#include "simulation.h"
+
+namespace tetris
+{
+  // ** cInputMapper
+  //
+  // Turns key and button events into inputs for the boards of a simulation.  Each binding maps a button on a device to
+  // an input on a board, so any number of players can share a keyboard or use their own controllers.  Presses and
+  // releases are sent with the time of the event, the simulation does the auto repeat.
+
+  enum class DEVICE {
+    KEYBOARD,
+    GAMECONTROLLER,
+  };
+
+  class cInputMapper
+  {
+  public:
+    explicit cInputMapper(cSimulation& simulation);
+
+    void AddBinding(DEVICE device, size_t deviceIndex, int button, size_t board, INPUT input);
+    void ClearBindings();
+
+    void OnButtonDown(DEVICE device, size_t deviceIndex, int button, timepoint_t time);
+    void OnButtonUp(DEVICE device, size_t deviceIndex, int button, timepoint_t time);
+
+    // Releases everything that is held down, for when we stop receiving events such as when the game is paused
+    void ReleaseAll(timepoint_t time);
+
+  private:
+    struct cBinding
+    {
+      DEVICE device;
+      size_t deviceIndex;
+      int button;
+      size_t board;
+      INPUT input;
+      bool bIsDown;
+    };
+
+    cSimulation& simulation;
+
+    std::vector<cBinding> bindings;
+  };
+}
+
+#endif // TETRIS_INPUT_H
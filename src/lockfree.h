@@ -0,0 +1,136 @@
+#ifndef TETRIS_LOCKFREE_H
+#define TETRIS_LOCKFREE_H
+
+// Standard headers
+#include <cstddef>
+#include <atomic>
+
+namespace tetris
+{
+  // ** cTripleBuffer
+  //
+  // Passes the latest value from one producer thread to one consumer thread without either of them ever waiting.  The
+  // producer fills the write buffer and publishes it, the consumer picks up the most recently published buffer, values
+  // that are published while the consumer is busy are skipped.
+
+  template <class T>
+  class cTripleBuffer
+  {
+  public:
+    cTripleBuffer();
+
+    // Producer
+    T& GetWriteBuffer() { return buffers[iWrite]; }
+    void Publish();
+
+    // Consumer, returns true if a new buffer was published since the last call
+    bool Consume();
+    const T& GetReadBuffer() const { return buffers[iRead]; }
+
+  private:
+    static const unsigned int INDEX_MASK = 0x3;
+    static const unsigned int FLAG_PUBLISHED = 0x4;
+
+    T buffers[3];
+
+    unsigned int iWrite;
+    unsigned int iRead;
+
+    // The index of the buffer that is not owned by either side, plus a flag if it has been published and not consumed yet
+    std::atomic<unsigned int> middle;
+  };
+
+  template <class T>
+  inline cTripleBuffer<T>::cTripleBuffer() :
+    iWrite(0),
+    iRead(1),
+    middle(2)
+  {
+  }
+
+  template <class T>
+  inline void cTripleBuffer<T>::Publish()
+  {
+    const unsigned int previous = middle.exchange(iWrite | FLAG_PUBLISHED, std::memory_order_acq_rel);
+    iWrite = (previous & INDEX_MASK);
+  }
+
+  template <class T>
+  inline bool cTripleBuffer<T>::Consume()
+  {
+    if ((middle.load(std::memory_order_relaxed) & FLAG_PUBLISHED) == 0) return false;
+
+    // Only the consumer clears the flag so it is still set, if the producer has published again since then we get the newer buffer
+    const unsigned int previous = middle.exchange(iRead, std::memory_order_acq_rel);
+    iRead = (previous & INDEX_MASK);
+
+    return true;
+  }
+
+  // ** cSingleProducerSingleConsumerRingBuffer
+  //
+  // A fixed size queue between exactly one producer thread and exactly one consumer thread.  Neither side locks or
+  // allocates, Push fails instead of overwriting if the consumer has fallen a whole buffer behind.
+
+  template <class T, size_t N>
+  class cSingleProducerSingleConsumerRingBuffer
+  {
+  public:
+    static_assert((N != 0) && ((N & (N - 1)) == 0), "N must be a power of two");
+
+    cSingleProducerSingleConsumerRingBuffer();
+
+    // Producer, returns false if the buffer is full
+    bool Push(const T& value);
+
+    // Consumer, returns nullptr if the buffer is empty, the item stays valid until Pop is called
+    const T* Front() const;
+    void Pop();
+
+    bool IsEmpty() const { return (Front() == nullptr); }
+
+  private:
+    T items[N];
+
+    // Both keep counting up and wrap around, only the low bits are used as an index
+    std::atomic<size_t> head; // Written by the consumer
+    std::atomic<size_t> tail; // Written by the producer
+  };
+
+  template <class T, size_t N>
+  inline cSingleProducerSingleConsumerRingBuffer<T, N>::cSingleProducerSingleConsumerRingBuffer() :
+    head(0),
+    tail(0)
+  {
+  }
+
+  template <class T, size_t N>
+  inline bool cSingleProducerSingleConsumerRingBuffer<T, N>::Push(const T& value)
+  {
+    const size_t i = tail.load(std::memory_order_relaxed);
+    if ((i - head.load(std::memory_order_acquire)) == N) return false;
+
+    items[i & (N - 1)] = value;
+    tail.store(i + 1, std::memory_order_release);
+
+    return true;
+  }
+
+  template <class T, size_t N>
+  inline const T* cSingleProducerSingleConsumerRingBuffer<T, N>::Front() const
+  {
+    const size_t i = head.load(std::memory_order_relaxed);
+    if (i == tail.load(std::memory_order_acquire)) return nullptr;
+
+    return &items[i & (N - 1)];
+  }
+
+  template <class T, size_t N>
+  inline void cSingleProducerSingleConsumerRingBuffer<T, N>::Pop()
+  {
+    const size_t i = head.load(std::memory_order_relaxed);
+    head.store(i + 1, std::memory_order_release);
+  }
+}
+
+#endif // TETRIS_LOCKFREE_H
@@ -1,8 +1,19 @@
+// Standard headers
+#include <string>
+
 // Tetris headers
 #include "application.h"
+#include "blockrenderer.h"
+#include "videoexport.h"
 
 int main(int argc, char** argv)
 {
+  // Convert a replay to a video without creating a window, "tetris --export-video last.replay video.y4m"
+  if ((argc == 4) && (std::string(argv[1]) == "--export-video")) return tetris::ExportReplayToVideo(argv[2], argv[3]);
+
+  // Compare the speed of the block geometry builders, "tetris --benchmark-block-geometry"
+  if ((argc == 2) && (std::string(argv[1]) == "--benchmark-block-geometry")) return BenchmarkBlockGeometry();
+
   #if defined(BUILD_DEBUG) && defined(PLATFORM_LINUX_OR_UNIX)
   // KDevelop only shows output sent to cerr, we redirect cout to cerr here so that it will show up
   // Back up cout's streambuf
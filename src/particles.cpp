@@ -0,0 +1,242 @@
+// Standard headers
+#include <cassert>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+
+// SSE2 is always available on x86-64, anywhere else the particles are moved one at a time
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define TETRIS_SSE2
+#include <emmintrin.h>
+#endif
+
+// Tetris headers
+#include "particles.h"
+
+namespace
+{
+  const GLuint ATTRIBUTE_POSITION = 0;
+  const GLuint ATTRIBUTE_INSTANCE_POSITION = 1;
+  const GLuint ATTRIBUTE_INSTANCE_COLOUR = 2;
+
+  // In the units of the 2D render mode per second per second, y increases down the screen
+  const float GRAVITY = 1.5f;
+
+  const float MIN_LIFETIME = 0.5f;
+  const float MAX_LIFETIME = 1.2f;
+
+  GLubyte ToByte(float value)
+  {
+    return GLubyte(std::max(0.0f, std::min(value, 1.0f)) * 255.0f + 0.5f);
+  }
+}
+
+// ** cParticleSystem
+
+cParticleSystem::cParticleSystem() :
+  nMaxParticles(0),
+  nParticles(0),
+  random(0x9e3779b9),
+  fUpdateDurationMS(0.0f),
+  vertexArrayObject(0),
+  bufferQuad(0)
+{
+}
+
+void cParticleSystem::Create(size_t _nMaxParticles)
+{
+  assert(vertexArrayObject == 0);
+
+  nMaxParticles = _nMaxParticles;
+  nParticles = 0;
+
+  x.resize(nMaxParticles);
+  y.resize(nMaxParticles);
+  vx.resize(nMaxParticles);
+  vy.resize(nMaxParticles);
+  life.resize(nMaxParticles);
+  lifetime.resize(nMaxParticles);
+  size.resize(nMaxParticles);
+  colour.resize(nMaxParticles);
+  staging.reserve(nMaxParticles);
+
+  // A unit quad as a triangle strip, the corners are also the texture coordinates
+  const GLfloat quad[] = {
+    0.0f, 1.0f,
+    1.0f, 1.0f,
+    0.0f, 0.0f,
+    1.0f, 0.0f
+  };
+
+  glGenVertexArrays(1, &vertexArrayObject);
+  glBindVertexArray(vertexArrayObject);
+
+  glGenBuffers(1, &bufferQuad);
+  glBindBuffer(GL_ARRAY_BUFFER, bufferQuad);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+  glEnableVertexAttribArray(ATTRIBUTE_POSITION);
+  glVertexAttribPointer(ATTRIBUTE_POSITION, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), nullptr);
+
+  instances.Create(nMaxParticles * sizeof(cParticleInstance));
+  glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_POSITION);
+  glVertexAttribPointer(ATTRIBUTE_INSTANCE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(cParticleInstance), nullptr);
+  glVertexAttribDivisor(ATTRIBUTE_INSTANCE_POSITION, 1);
+  glEnableVertexAttribArray(ATTRIBUTE_INSTANCE_COLOUR);
+  glVertexAttribPointer(ATTRIBUTE_INSTANCE_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(cParticleInstance), (const GLvoid*)(3 * sizeof(GLfloat)));
+  glVertexAttribDivisor(ATTRIBUTE_INSTANCE_COLOUR, 1);
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void cParticleSystem::Destroy()
+{
+  instances.Destroy();
+
+  if (bufferQuad != 0) {
+    glDeleteBuffers(1, &bufferQuad);
+    bufferQuad = 0;
+  }
+
+  if (vertexArrayObject != 0) {
+    glDeleteVertexArrays(1, &vertexArrayObject);
+    vertexArrayObject = 0;
+  }
+
+  nMaxParticles = 0;
+  nParticles = 0;
+}
+
+float cParticleSystem::_GetRandomZeroToOne()
+{
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  return float(random >> 8) / float(1 << 24);
+}
+
+void cParticleSystem::Emit(const spitfire::math::cVec2& position, const spitfire::math::cVec2& area, const spitfire::math::cColour& _colour, size_t n, float fSpeed, float fSize)
+{
+  const GLubyte packed[4] = { ToByte(_colour.r), ToByte(_colour.g), ToByte(_colour.b), ToByte(_colour.a) };
+  uint32_t value = 0;
+  std::memcpy(&value, packed, sizeof(value));
+
+  n = std::min(n, nMaxParticles - nParticles);
+  for (size_t i = 0; i < n; i++) {
+    const size_t j = nParticles + i;
+
+    x[j] = position.x + (area.x * _GetRandomZeroToOne());
+    y[j] = position.y + (area.y * _GetRandomZeroToOne());
+
+    // Mostly sideways and up out of the line
+    vx[j] = fSpeed * ((2.0f * _GetRandomZeroToOne()) - 1.0f);
+    vy[j] = -fSpeed * _GetRandomZeroToOne();
+
+    lifetime[j] = MIN_LIFETIME + ((MAX_LIFETIME - MIN_LIFETIME) * _GetRandomZeroToOne());
+    life[j] = lifetime[j];
+    size[j] = fSize * (0.5f + (0.5f * _GetRandomZeroToOne()));
+    colour[j] = value;
+  }
+
+  nParticles += n;
+}
+
+void cParticleSystem::_Remove(size_t i)
+{
+  // The order doesn't matter so the last particle is moved into the gap
+  const size_t last = nParticles - 1;
+  x[i] = x[last];
+  y[i] = y[last];
+  vx[i] = vx[last];
+  vy[i] = vy[last];
+  life[i] = life[last];
+  lifetime[i] = lifetime[last];
+  size[i] = size[last];
+  colour[i] = colour[last];
+
+  nParticles--;
+}
+
+void cParticleSystem::Update(float fTimeStepSeconds)
+{
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  const float dt = fTimeStepSeconds;
+  const float dv = GRAVITY * dt;
+
+  bool bIsAnyDead = false;
+
+  size_t i = 0;
+
+  #ifdef TETRIS_SSE2
+  const __m128 dt4 = _mm_set1_ps(dt);
+  const __m128 dv4 = _mm_set1_ps(dv);
+  const __m128 zero = _mm_setzero_ps();
+  int dead = 0;
+
+  for (; (i + 4) <= nParticles; i += 4) {
+    const __m128 vx4 = _mm_loadu_ps(&vx[i]);
+    const __m128 vy4 = _mm_add_ps(_mm_loadu_ps(&vy[i]), dv4);
+    _mm_storeu_ps(&vy[i], vy4);
+
+    _mm_storeu_ps(&x[i], _mm_add_ps(_mm_loadu_ps(&x[i]), _mm_mul_ps(vx4, dt4)));
+    _mm_storeu_ps(&y[i], _mm_add_ps(_mm_loadu_ps(&y[i]), _mm_mul_ps(vy4, dt4)));
+
+    const __m128 life4 = _mm_sub_ps(_mm_loadu_ps(&life[i]), dt4);
+    _mm_storeu_ps(&life[i], life4);
+    dead |= _mm_movemask_ps(_mm_cmple_ps(life4, zero));
+  }
+
+  bIsAnyDead = (dead != 0);
+  #endif
+
+  for (; i < nParticles; i++) {
+    vy[i] += dv;
+    x[i] += vx[i] * dt;
+    y[i] += vy[i] * dt;
+    life[i] -= dt;
+    if (life[i] <= 0.0f) bIsAnyDead = true;
+  }
+
+  // Most frames nothing dies so we only look for dead particles when the kernel saw one
+  if (bIsAnyDead) {
+    for (i = 0; i < nParticles;) {
+      if (life[i] <= 0.0f) _Remove(i);
+      else i++;
+    }
+  }
+
+  fUpdateDurationMS = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void cParticleSystem::Render()
+{
+  assert(vertexArrayObject != 0);
+
+  if (nParticles == 0) return;
+
+  staging.resize(nParticles);
+  for (size_t i = 0; i < nParticles; i++) {
+    cParticleInstance& instance = staging[i];
+    instance.x = x[i];
+    instance.y = y[i];
+    instance.fSize = size[i];
+    std::memcpy(&instance.r, &colour[i], sizeof(uint32_t));
+
+    // Fade out as the particle runs out of life
+    instance.a = GLubyte(float(instance.a) * (life[i] / lifetime[i]));
+  }
+
+  const size_t offset = instances.Write(&staging[0], staging.size() * sizeof(cParticleInstance));
+
+  // Point the instance attributes at the segment we just wrote to
+  glBindVertexArray(vertexArrayObject);
+  glVertexAttribPointer(ATTRIBUTE_INSTANCE_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(cParticleInstance), (const GLvoid*)offset);
+  glVertexAttribPointer(ATTRIBUTE_INSTANCE_COLOUR, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(cParticleInstance), (const GLvoid*)(offset + (3 * sizeof(GLfloat))));
+
+  glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(nParticles));
+
+  glBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
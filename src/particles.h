@@ -0,0 +1,87 @@
+#ifndef TETRIS_PARTICLES_H
+#define TETRIS_PARTICLES_H
+
+// Standard headers
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// OpenGL headers
+#include <GL/GLee.h>
+
+// Spitfire headers
+#include <spitfire/math/cVec2.h>
+#include <spitfire/math/cColour.h>
+
+// Tetris headers
+#include "blockrenderer.h"
+
+// ** cParticleSystem
+//
+// Small shards of blocks that fly out of cleared lines.  Each attribute of the particles is in its own array so the
+// update can move four particles at a time with SSE2, dead particles are swapped with the last particle so the arrays
+// are always packed.  Every particle is drawn in one instanced draw with particle.vert.
+
+struct cParticleInstance
+{
+  GLfloat x;
+  GLfloat y;
+  GLfloat fSize;
+  GLubyte r;
+  GLubyte g;
+  GLubyte b;
+  GLubyte a;
+};
+
+class cParticleSystem
+{
+public:
+  cParticleSystem();
+
+  void Create(size_t nMaxParticles);
+  void Destroy();
+
+  bool IsEmpty() const { return (nParticles == 0); }
+  size_t GetCount() const { return nParticles; }
+  size_t GetMaxParticles() const { return nMaxParticles; }
+
+  // Adds particles spread over a rectangle flying outwards at up to fSpeed, particles past the maximum are dropped
+  void Emit(const spitfire::math::cVec2& position, const spitfire::math::cVec2& area, const spitfire::math::cColour& colour, size_t n, float fSpeed, float fSize);
+
+  void Update(float fTimeStepSeconds);
+
+  // Draws every particle with the currently bound shader and texture
+  void Render();
+
+  // How long the last call to Update took
+  float GetUpdateDurationMS() const { return fUpdateDurationMS; }
+
+private:
+  float _GetRandomZeroToOne();
+
+  void _Remove(size_t i);
+
+  size_t nMaxParticles;
+  size_t nParticles;
+
+  // The particles, only the first nParticles of each are used
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> vx;
+  std::vector<float> vy;
+  std::vector<float> life; // Seconds left
+  std::vector<float> lifetime; // Seconds that the particle started with, the particle fades out as it runs out of life
+  std::vector<float> size;
+  std::vector<uint32_t> colour; // Packed the same as the colour of an instance
+
+  uint32_t random; // xorshift state, particles don't need to be the same between runs
+
+  float fUpdateDurationMS;
+
+  GLuint vertexArrayObject;
+  GLuint bufferQuad;
+  cStreamingBuffer instances;
+  std::vector<cParticleInstance> staging; // Reused for each frame so that we don't allocate
+};
+
+#endif // TETRIS_PARTICLES_H
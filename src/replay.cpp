@@ -0,0 +1,185 @@
+// Standard headers
+#include <cassert>
+
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include <vector>
+
+// Spitfire headers
+#include <spitfire/math/math.h>
+
+// Tetris headers
+#include "replay.h"
+#include "simulation.h"
+
+namespace tetris
+{
+  namespace
+  {
+    const char* REPLAY_HEADER = "tetris_replay";
+    const size_t REPLAY_VERSION = 1;
+  }
+
+  // ** cReplay
+
+  cReplay::cReplay() :
+    nBoards(0),
+    startTime(0),
+    ticks(0)
+  {
+  }
+
+  void cReplay::Clear()
+  {
+    nBoards = 0;
+    startTime = 0;
+    ticks = 0;
+    inputs.clear();
+  }
+
+  void cReplay::Start(size_t _nBoards, spitfire::durationms_t _startTime)
+  {
+    Clear();
+
+    nBoards = _nBoards;
+    startTime = _startTime;
+  }
+
+  void cReplay::AddInput(uint64_t tick, size_t board, INPUT input)
+  {
+    assert(board < nBoards);
+    assert(inputs.empty() || (inputs.back().tick <= tick));
+
+    cReplayInput replayInput;
+    replayInput.tick = tick;
+    replayInput.board = board;
+    replayInput.input = input;
+    inputs.push_back(replayInput);
+  }
+
+  void cReplay::Stop(uint64_t tick)
+  {
+    ticks = tick;
+  }
+
+  bool cReplay::Load(const std::string& sFilePath)
+  {
+    Clear();
+
+    std::ifstream i(sFilePath.c_str());
+    if (!i.good()) {
+      std::cout<<"cReplay::Load \""<<sFilePath<<"\" not found"<<std::endl;
+      return false;
+    }
+
+    std::string sHeader;
+    size_t version = 0;
+    std::string sBoards;
+    std::string sStartTime;
+    std::string sTicks;
+    std::string sInputs;
+    size_t nInputs = 0;
+    i>>sHeader>>version>>sBoards>>nBoards>>sStartTime>>startTime>>sTicks>>ticks>>sInputs>>nInputs;
+    if (!i.good() || (sHeader != REPLAY_HEADER) || (version != REPLAY_VERSION) || (sBoards != "boards") || (sStartTime != "start_time") || (sTicks != "ticks") || (sInputs != "inputs")) {
+      std::cout<<"cReplay::Load \""<<sFilePath<<"\" is not a replay"<<std::endl;
+      Clear();
+      return false;
+    }
+
+    inputs.reserve(nInputs);
+    for (size_t j = 0; j < nInputs; j++) {
+      cReplayInput replayInput;
+      size_t input = 0;
+      i>>replayInput.tick>>replayInput.board>>input;
+      if (i.fail() || (replayInput.board >= nBoards) || (input >= INPUT_COUNT)) {
+        std::cout<<"cReplay::Load \""<<sFilePath<<"\" input "<<j<<" is invalid"<<std::endl;
+        Clear();
+        return false;
+      }
+
+      replayInput.input = INPUT(input);
+      inputs.push_back(replayInput);
+    }
+
+    return true;
+  }
+
+  bool cReplay::Save(const std::string& sFilePath) const
+  {
+    std::ofstream o(sFilePath.c_str());
+    if (!o.good()) {
+      std::cout<<"cReplay::Save Error saving to file \""<<sFilePath<<"\""<<std::endl;
+      return false;
+    }
+
+    o<<REPLAY_HEADER<<" "<<REPLAY_VERSION<<"\n";
+    o<<"boards "<<nBoards<<"\n";
+    o<<"start_time "<<startTime<<"\n";
+    o<<"ticks "<<ticks<<"\n";
+    o<<"inputs "<<inputs.size()<<"\n";
+
+    const size_t n = inputs.size();
+    for (size_t i = 0; i < n; i++) o<<inputs[i].tick<<" "<<inputs[i].board<<" "<<size_t(inputs[i].input)<<"\n";
+
+    return o.good();
+  }
+
+
+  // ** cReplayPlayer
+
+  cReplayPlayer::cReplayPlayer(const cReplay& _replay) :
+    replay(_replay),
+    currentTime(_replay.GetStartTime()),
+    nextInput(0)
+  {
+    // The game is seeded from the start time so the boards start the same and are given the same pieces
+    const size_t nBoards = replay.GetBoards();
+    for (size_t i = 0; i < nBoards; i++) game.boards.push_back(new cBoard(game));
+    game.StartGame(currentTime);
+  }
+
+  cReplayPlayer::~cReplayPlayer()
+  {
+    for (size_t i = 0; i < game.boards.size(); i++) spitfire::SAFE_DELETE(game.boards[i]);
+    game.boards.clear();
+  }
+
+  bool cReplayPlayer::IsFinished() const
+  {
+    if (game.GetTick() >= replay.GetTicks()) return true;
+
+    // Once every board is game over nothing else can happen
+    const size_t n = game.boards.size();
+    for (size_t i = 0; i < n; i++) {
+      if (game.boards[i]->IsPlaying()) return false;
+    }
+
+    return true;
+  }
+
+  void cReplayPlayer::Step(cEventBuffer& events)
+  {
+    // The same order as cSimulation::_Tick, the time moves forward, then the inputs are applied, then the game is updated
+    currentTime += SIMULATION_TICK_MS;
+
+    const std::vector<cReplayInput>& inputs = replay.GetInputs();
+    const uint64_t tick = game.GetTick();
+    while ((nextInput < inputs.size()) && (inputs[nextInput].tick <= tick)) {
+      const cReplayInput& input = inputs[nextInput];
+      game.boards[input.board]->ApplyInput(input.input, currentTime);
+      nextInput++;
+    }
+
+    game.Update(currentTime);
+
+    game.TakeEvents(events);
+  }
+
+  void cReplayPlayer::GetSnapshot(cGameSnapshot& snapshot) const
+  {
+    game.GetSnapshot(snapshot);
+    snapshot.currentTime = currentTime;
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef TETRIS_REPLAY_H
+#define TETRIS_REPLAY_H
+
+// Standard headers
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Tetris headers
+#include "tetris.h"
+
+namespace tetris
+{
+  // ** cReplay
+  //
+  // Everything needed to play a game again without a window, the number of boards, the start time that the random
+  // number generator of the game was seeded with and each input along with the tick that it was applied on.
+
+  class cReplayInput
+  {
+  public:
+    uint64_t tick;
+    size_t board;
+    INPUT input;
+  };
+
+  class cReplay
+  {
+  public:
+    cReplay();
+
+    void Clear();
+
+    void Start(size_t nBoards, spitfire::durationms_t startTime);
+    void AddInput(uint64_t tick, size_t board, INPUT input);
+    void Stop(uint64_t tick);
+
+    size_t GetBoards() const { return nBoards; }
+    spitfire::durationms_t GetStartTime() const { return startTime; }
+    uint64_t GetTicks() const { return ticks; }
+    const std::vector<cReplayInput>& GetInputs() const { return inputs; }
+
+    bool Load(const std::string& sFilePath);
+    bool Save(const std::string& sFilePath) const;
+
+  private:
+    size_t nBoards;
+    spitfire::durationms_t startTime;
+    uint64_t ticks;
+    std::vector<cReplayInput> inputs;
+  };
+
+
+  // ** cReplayPlayer
+  //
+  // Runs a replay on the calling thread as fast as it can be updated, one tick at a time, with the same tick length and
+  // input order as cSimulation
+
+  class cReplayPlayer
+  {
+  public:
+    explicit cReplayPlayer(const cReplay& replay);
+    ~cReplayPlayer();
+
+    bool IsFinished() const;
+
+    spitfire::durationms_t GetCurrentTime() const { return currentTime; }
+
+    // Applies the inputs for the next tick and then updates the game, the events are appended to events
+    void Step(cEventBuffer& events);
+
+    void GetSnapshot(cGameSnapshot& snapshot) const;
+
+  private:
+    const cReplay& replay;
+
+    cGame game;
+    spitfire::durationms_t currentTime;
+    size_t nextInput;
+  };
+}
+
+#endif // TETRIS_REPLAY_H
@@ -163,6 +163,16 @@ void cSettings::SetNumberOfPlayers(size_t nPlayers)
   SetXMLValue(TEXT("settings"), TEXT("numberOfPlayers"), TEXT("value"), nPlayers);
 }
 
+size_t cSettings::GetNumberOfSpectatorBoards() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("spectatorBoards"), TEXT("value"), 0);
+}
+
+void cSettings::SetNumberOfSpectatorBoards(size_t nBoards)
+{
+  SetXMLValue(TEXT("settings"), TEXT("spectatorBoards"), TEXT("value"), nBoards);
+}
+
 spitfire::string_t cSettings::GetPlayerName(size_t i) const
 {
   spitfire::ostringstream_t o;
@@ -219,6 +229,56 @@ void cSettings::SetPlayerColour(size_t i, const spitfire::string_t& colour)
   SetXMLValue(TEXT("settings"), sItem, TEXT("colour"), colour);
 }
 
+spitfire::string_t cSettings::GetBlockRenderer() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("blockRenderer"), TEXT("value"), spitfire::string_t(TEXT("instanced")));
+}
+
+void cSettings::SetBlockRenderer(const spitfire::string_t& sRenderer)
+{
+  SetXMLValue(TEXT("settings"), TEXT("blockRenderer"), TEXT("value"), sRenderer);
+}
+
+spitfire::string_t cSettings::GetLetterBoxMode() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("letterBox"), TEXT("value"), spitfire::string_t(TEXT("viewport")));
+}
+
+void cSettings::SetLetterBoxMode(const spitfire::string_t& sMode)
+{
+  SetXMLValue(TEXT("settings"), TEXT("letterBox"), TEXT("value"), sMode);
+}
+
+float cSettings::GetRenderScale() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("renderScale"), TEXT("value"), 1.0f);
+}
+
+void cSettings::SetRenderScale(float fScale)
+{
+  SetXMLValue(TEXT("settings"), TEXT("renderScale"), TEXT("value"), fScale);
+}
+
+spitfire::string_t cSettings::GetVSync() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("vsync"), TEXT("value"), spitfire::string_t(TEXT("adaptive")));
+}
+
+void cSettings::SetVSync(const spitfire::string_t& sVSync)
+{
+  SetXMLValue(TEXT("settings"), TEXT("vsync"), TEXT("value"), sVSync);
+}
+
+size_t cSettings::GetFrameRateLimit() const
+{
+  return GetXMLValue(TEXT("settings"), TEXT("frameRateLimit"), TEXT("value"), 0);
+}
+
+void cSettings::SetFrameRateLimit(size_t framesPerSecond)
+{
+  SetXMLValue(TEXT("settings"), TEXT("frameRateLimit"), TEXT("value"), framesPerSecond);
+}
+
 std::vector<cHighScoresTableEntry> cSettings::GetHighScores() const
 {
   std::vector<cHighScoresTableEntry> entries;
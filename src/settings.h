@@ -33,11 +33,35 @@ public:
   size_t GetNumberOfPlayers() const;
   void SetNumberOfPlayers(size_t nPlayers);
 
+  // Extra boards that nobody is playing on, for trying out the layout of large matches
+  size_t GetNumberOfSpectatorBoards() const;
+  void SetNumberOfSpectatorBoards(size_t nBoards);
+
   spitfire::string_t GetPlayerName(size_t i) const;
   void SetPlayerName(size_t i, const spitfire::string_t& sName);
   spitfire::string_t GetPlayerColour(size_t i) const;
   void SetPlayerColour(size_t i, const spitfire::string_t& colour);
 
+  // "instanced", "geometry" or "texture"
+  spitfire::string_t GetBlockRenderer() const;
+  void SetBlockRenderer(const spitfire::string_t& sRenderer);
+
+  // "viewport" draws straight to the letter boxed rectangle of the screen, "texture" draws to a texture and then copies it to the screen
+  spitfire::string_t GetLetterBoxMode() const;
+  void SetLetterBoxMode(const spitfire::string_t& sMode);
+
+  // Less than 1 draws to a smaller texture which is scaled up to the screen, for slower machines
+  float GetRenderScale() const;
+  void SetRenderScale(float fScale);
+
+  // "adaptive" only waits for vsync when the frame is on time, "on" always waits and "off" never waits
+  spitfire::string_t GetVSync() const;
+  void SetVSync(const spitfire::string_t& sVSync);
+
+  // 0 limits the frame rate to the refresh rate of the display when we can't wait for vsync
+  size_t GetFrameRateLimit() const;
+  void SetFrameRateLimit(size_t framesPerSecond);
+
   std::vector<cHighScoresTableEntry> GetHighScores() const;
   void SetHighScores(const std::vector<cHighScoresTableEntry>& entries);
 
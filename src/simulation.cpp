@@ -0,0 +1,337 @@
+// Standard headers
+#include <cassert>
+
+#include <string>
+#include <iostream>
+
+#include <chrono>
+#include <list>
+#include <vector>
+
+// Tetris headers
+#include "simulation.h"
+
+namespace tetris
+{
+  // ** cSimulation
+
+  cSimulation::cHeldInputs::cHeldInputs()
+  {
+    for (size_t i = 0; i < INPUT_COUNT; i++) nHeld[i] = 0;
+  }
+
+  cSimulation::cSimulation() :
+    currentTime(0),
+
+    nInputsApplied(0),
+    inputLatencyTotal(0),
+    inputLatencyMax(0),
+
+    bIsRunning(false),
+    bIsPaused(false),
+
+    nInputsDropped(0)
+  {
+  }
+
+  cSimulation::~cSimulation()
+  {
+    StopGame();
+  }
+
+  void cSimulation::StartGame(size_t nBoards, spitfire::durationms_t _currentTime)
+  {
+    assert(!bIsRunning);
+    assert(game.boards.empty());
+
+    currentTime = _currentTime;
+
+    nInputsApplied = 0;
+    inputLatencyTotal = std::chrono::microseconds(0);
+    inputLatencyMax = std::chrono::microseconds(0);
+    nInputsDropped = 0;
+
+    for (size_t i = 0; i < nBoards; i++) inputQueues.push_back(new cInputQueue);
+    heldInputs.assign(nBoards, cHeldInputs());
+
+    for (size_t i = 0; i < nBoards; i++) game.boards.push_back(new cBoard(game));
+    game.StartGame(currentTime);
+
+    replay.Start(nBoards, currentTime);
+
+    // Every board is given the same pieces
+    possiblePieces.clear();
+    if (!game.boards.empty()) {
+      const std::list<cPiece>& pieces = game.boards[0]->GetPossiblePieces();
+      possiblePieces.assign(pieces.begin(), pieces.end());
+    }
+
+#ifdef BUILD_DESYNC_CHECKER
+    for (size_t i = 0; i < nBoards; i++) replicaGame.boards.push_back(new cBoard(replicaGame));
+    replicaGame.StartGame(currentTime);
+    replicaGame.ClearEvents();
+
+    desyncChecker.CompareReplicas(game, replicaGame);
+#endif
+
+    // Publish the starting state and pick it up straight away so that the caller can create its representations of the boards
+    _Publish(std::chrono::steady_clock::now());
+    snapshots.Consume();
+
+    bIsPaused = false;
+    bIsRunning = true;
+    thread = std::thread(&cSimulation::_Run, this);
+  }
+
+  void cSimulation::StopGame()
+  {
+    if (bIsRunning) {
+      bIsRunning = false;
+      thread.join();
+
+      replay.Stop(game.GetTick());
+
+      if (nInputsApplied != 0) {
+        std::cout<<"cSimulation::StopGame "<<nInputsApplied<<" inputs applied, latency average "<<(inputLatencyTotal.count() / nInputsApplied)<<"us, max "<<inputLatencyMax.count()<<"us"<<std::endl;
+      }
+      if (nInputsDropped != 0) std::cout<<"cSimulation::StopGame "<<nInputsDropped<<" inputs dropped"<<std::endl;
+    }
+
+    for (size_t i = 0; i < inputQueues.size(); i++) spitfire::SAFE_DELETE(inputQueues[i]);
+    inputQueues.clear();
+    heldInputs.clear();
+    possiblePieces.clear();
+
+    for (size_t i = 0; i < game.boards.size(); i++) spitfire::SAFE_DELETE(game.boards[i]);
+    game.boards.clear();
+
+#ifdef BUILD_DESYNC_CHECKER
+    for (size_t i = 0; i < replicaGame.boards.size(); i++) spitfire::SAFE_DELETE(replicaGame.boards[i]);
+    replicaGame.boards.clear();
+#endif
+  }
+
+  void cSimulation::Pause()
+  {
+    bIsPaused = true;
+  }
+
+  void cSimulation::Resume()
+  {
+    bIsPaused = false;
+  }
+
+  void cSimulation::QueueInput(size_t board, INPUT input)
+  {
+    QueueInput(board, input, std::chrono::steady_clock::now());
+  }
+
+  void cSimulation::QueueInput(size_t board, INPUT input, timepoint_t time)
+  {
+    // Released straight away so it is applied once and never repeated
+    _PushInput(board, input, true, time);
+    _PushInput(board, input, false, time);
+  }
+
+  void cSimulation::QueueInputDown(size_t board, INPUT input, timepoint_t time)
+  {
+    _PushInput(board, input, true, time);
+  }
+
+  void cSimulation::QueueInputUp(size_t board, INPUT input, timepoint_t time)
+  {
+    _PushInput(board, input, false, time);
+  }
+
+  bool cSimulation::GetAutoRepeat(INPUT input, std::chrono::milliseconds& delay, std::chrono::milliseconds& interval)
+  {
+    switch (input) {
+      case INPUT::PIECE_MOVE_LEFT:
+      case INPUT::PIECE_MOVE_RIGHT: {
+        delay = std::chrono::milliseconds(150);
+        interval = std::chrono::milliseconds(50);
+        return true;
+      }
+      case INPUT::PIECE_DROP_ONE_ROW: {
+        delay = std::chrono::milliseconds(30);
+        interval = std::chrono::milliseconds(30);
+        return true;
+      }
+      case INPUT::PIECE_ROTATE_COUNTER_CLOCKWISE:
+      case INPUT::PIECE_ROTATE_CLOCKWISE:
+      case INPUT::PIECE_DROP_TO_GROUND: {
+        break;
+      }
+    }
+
+    return false;
+  }
+
+  void cSimulation::_PushInput(size_t board, INPUT input, bool bIsDown, timepoint_t time)
+  {
+    assert(board < inputQueues.size());
+
+    cQueuedInput queuedInput;
+    queuedInput.input = input;
+    queuedInput.bIsDown = bIsDown;
+    queuedInput.time = time;
+
+    if (!inputQueues[board]->Push(queuedInput)) {
+      std::cout<<"cSimulation::QueueInput Input queue for board "<<board<<" is full, dropping input"<<std::endl;
+      nInputsDropped++;
+    }
+  }
+
+  bool cSimulation::DispatchEvents(cView& view)
+  {
+    cEventBuffer dispatching;
+    {
+      std::lock_guard<std::mutex> lock(mutexEvents);
+      dispatching.Swap(events);
+    }
+
+    // Snapshots are published before their events so this snapshot is at least as new as every event we are about to send
+    snapshots.Consume();
+
+    if (dispatching.IsEmpty()) return false;
+
+    dispatching.Coalesce();
+    dispatching.Dispatch(snapshots.GetReadBuffer(), view);
+
+    return true;
+  }
+
+  void cSimulation::_Run()
+  {
+    const std::chrono::milliseconds tickDuration(SIMULATION_TICK_MS);
+
+    std::chrono::steady_clock::time_point nextTick = std::chrono::steady_clock::now() + tickDuration;
+
+    while (bIsRunning) {
+      std::this_thread::sleep_until(nextTick);
+
+      if (bIsPaused) {
+        // Start counting again when we are resumed rather than trying to catch up on the time spent paused
+        nextTick = std::chrono::steady_clock::now() + tickDuration;
+        continue;
+      }
+
+      _Tick(nextTick);
+
+      nextTick += tickDuration;
+
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if ((now - nextTick) > (int(nMaxCatchUpTicks) * tickDuration)) {
+        std::cout<<"cSimulation::_Run Simulation has fallen behind, skipping ahead"<<std::endl;
+        nextTick = now;
+      }
+    }
+  }
+
+  void cSimulation::_Tick(timepoint_t tickTime)
+  {
+    // The game only ever sees simulation time so that it runs the same no matter how late this tick is
+    currentTime += SIMULATION_TICK_MS;
+
+    _ApplyInputs(tickTime);
+
+    game.Update(currentTime);
+
+#ifdef BUILD_DESYNC_CHECKER
+    replicaGame.Update(currentTime);
+    replicaGame.ClearEvents();
+
+    desyncChecker.CompareReplicas(game, replicaGame);
+#endif
+
+    _Publish(tickTime);
+  }
+
+  void cSimulation::_ApplyInputs(timepoint_t tickTime)
+  {
+    const timepoint_t now = std::chrono::steady_clock::now();
+
+    const size_t nBoards = inputQueues.size();
+    for (size_t i = 0; i < nBoards; i++) {
+      cInputQueue& queue = *inputQueues[i];
+      cHeldInputs& held = heldInputs[i];
+
+      // Inputs that happened after this tick was due are left for the next tick
+      const cQueuedInput* pQueuedInput = queue.Front();
+      while ((pQueuedInput != nullptr) && (pQueuedInput->time <= tickTime)) {
+        // Any repeats that were due before this input happen first
+        _ApplyHeldInputs(i, pQueuedInput->time);
+
+        const size_t index = size_t(pQueuedInput->input);
+
+        std::chrono::milliseconds delay(0);
+        std::chrono::milliseconds interval(0);
+        const bool bIsRepeated = GetAutoRepeat(pQueuedInput->input, delay, interval);
+
+        if (pQueuedInput->bIsDown) {
+          _ApplyInput(i, pQueuedInput->input);
+
+          const std::chrono::microseconds latency = std::chrono::duration_cast<std::chrono::microseconds>(now - pQueuedInput->time);
+          nInputsApplied++;
+          inputLatencyTotal += latency;
+          if (latency > inputLatencyMax) inputLatencyMax = latency;
+
+          if (bIsRepeated) {
+            if (held.nHeld[index] == 0) held.nextRepeat[index] = pQueuedInput->time + delay;
+            held.nHeld[index]++;
+          }
+        } else if (bIsRepeated && (held.nHeld[index] != 0)) held.nHeld[index]--;
+
+        queue.Pop();
+        pQueuedInput = queue.Front();
+      }
+
+      _ApplyHeldInputs(i, tickTime);
+    }
+  }
+
+  void cSimulation::_ApplyHeldInputs(size_t board, timepoint_t until)
+  {
+    cHeldInputs& held = heldInputs[board];
+
+    for (size_t i = 0; i < INPUT_COUNT; i++) {
+      if (held.nHeld[i] == 0) continue;
+
+      const INPUT input = INPUT(i);
+
+      std::chrono::milliseconds delay(0);
+      std::chrono::milliseconds interval(0);
+      GetAutoRepeat(input, delay, interval);
+
+      // If we have fallen a long way behind we skip the missed repeats rather than applying them all at once
+      if ((until - held.nextRepeat[i]) > (int(nMaxCatchUpTicks) * interval)) held.nextRepeat[i] = until;
+
+      while (held.nextRepeat[i] <= until) {
+        _ApplyInput(board, input);
+        held.nextRepeat[i] += interval;
+      }
+    }
+  }
+
+  void cSimulation::_ApplyInput(size_t board, INPUT input)
+  {
+    game.boards[board]->ApplyInput(input, currentTime);
+    replay.AddInput(game.GetTick(), board, input);
+#ifdef BUILD_DESYNC_CHECKER
+    replicaGame.boards[board]->ApplyInput(input, currentTime);
+#endif
+  }
+
+  void cSimulation::_Publish(timepoint_t tickTime)
+  {
+    cGameSnapshot& snapshot = snapshots.GetWriteBuffer();
+    game.GetSnapshot(snapshot);
+    snapshot.currentTime = currentTime;
+    snapshot.tickTime = tickTime;
+    snapshots.Publish();
+
+    // The events must be published after the snapshot that they refer to
+    std::lock_guard<std::mutex> lock(mutexEvents);
+    game.TakeEvents(events);
+  }
+}
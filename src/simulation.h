@@ -0,0 +1,132 @@
+#ifndef TETRIS_SIMULATION_H
+#define TETRIS_SIMULATION_H
+
+// Standard headers
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+// Tetris headers
+#include "desync.h"
+#include "lockfree.h"
+#include "replay.h"
+#include "tetris.h"
+
+namespace tetris
+{
+  // ** cSimulation
+  //
+  // Runs a game on its own thread at a fixed tick rate.  The render thread only sees the snapshots and events that are
+  // published after each tick, so a slow frame never delays gravity or input handling and the frame rate and tick rate
+  // are independent of each other.
+
+  const spitfire::durationms_t SIMULATION_TICK_MS = 10;
+
+  typedef std::chrono::steady_clock::time_point timepoint_t;
+
+  class cSimulation
+  {
+  public:
+    cSimulation();
+    ~cSimulation();
+
+    // Creates the boards, starts them and then starts the simulation thread
+    void StartGame(size_t nBoards, spitfire::durationms_t currentTime);
+    void StopGame();
+
+    void Pause();
+    void Resume();
+
+    // Called from the thread that handles input events only, the input is applied on the first tick that is scheduled at
+    // or after the time of the input
+    void QueueInput(size_t board, INPUT input);
+    void QueueInput(size_t board, INPUT input, timepoint_t time);
+
+    // Inputs that can be held are auto repeated by the simulation from the time they are pressed until they are released
+    void QueueInputDown(size_t board, INPUT input, timepoint_t time);
+    void QueueInputUp(size_t board, INPUT input, timepoint_t time);
+
+    // Returns false if this input is not repeated while it is held
+    static bool GetAutoRepeat(INPUT input, std::chrono::milliseconds& delay, std::chrono::milliseconds& interval);
+
+    // Picks up the latest snapshot and then sends the events that have happened since the last call to the view, returns
+    // false if nothing has happened
+    bool DispatchEvents(cView& view);
+
+    // The snapshot picked up by the last call to DispatchEvents
+    const cGameSnapshot& GetSnapshot() const { return snapshots.GetReadBuffer(); }
+
+    // Every piece that can be played in this game, set by StartGame and then never changed so it can be read from any thread
+    const std::vector<cPiece>& GetPossiblePieces() const { return possiblePieces; }
+
+    // Every input that was applied and the tick it was applied on, only complete once StopGame has been called
+    const cReplay& GetReplay() const { return replay; }
+
+  private:
+    void _Run();
+    void _Tick(timepoint_t tickTime);
+    void _ApplyInputs(timepoint_t tickTime);
+    void _ApplyHeldInputs(size_t board, timepoint_t until);
+    void _ApplyInput(size_t board, INPUT input);
+    void _PushInput(size_t board, INPUT input, bool bIsDown, timepoint_t time);
+    void _Publish(timepoint_t tickTime);
+
+    struct cQueuedInput
+    {
+      INPUT input;
+      bool bIsDown;
+      timepoint_t time;
+    };
+
+    struct cHeldInputs
+    {
+      cHeldInputs();
+
+      size_t nHeld[INPUT_COUNT]; // The same input can be held down by more than one binding at a time
+      timepoint_t nextRepeat[INPUT_COUNT];
+    };
+
+    // Enough for several seconds of button mashing, if it ever fills up the simulation thread has stalled
+    typedef cSingleProducerSingleConsumerRingBuffer<cQueuedInput, 256> cInputQueue;
+
+    // If we fall further behind than this, for example when the machine was suspended, we skip ahead instead of catching up
+    static const size_t nMaxCatchUpTicks = 10;
+
+    // Only touched by the simulation thread once it has started
+    cGame game;
+    spitfire::durationms_t currentTime;
+
+    // How long inputs waited between being queued and being applied
+    size_t nInputsApplied;
+    std::chrono::microseconds inputLatencyTotal;
+    std::chrono::microseconds inputLatencyMax;
+
+    std::vector<cHeldInputs> heldInputs;
+
+    cReplay replay;
+
+#ifdef BUILD_DESYNC_CHECKER
+    // A second copy of the game that is sent the same inputs, any difference between the two is reported
+    cGame replicaGame;
+    cDesyncChecker desyncChecker;
+#endif
+
+    std::thread thread;
+    std::atomic<bool> bIsRunning;
+    std::atomic<bool> bIsPaused;
+
+    // One queue for each board, created before the simulation thread is started
+    std::vector<cInputQueue*> inputQueues;
+    size_t nInputsDropped; // Only touched by the input thread
+
+    std::vector<cPiece> possiblePieces;
+
+    cTripleBuffer<cGameSnapshot> snapshots;
+
+    std::mutex mutexEvents;
+    cEventBuffer events;
+  };
+}
+
+#endif // TETRIS_SIMULATION_H
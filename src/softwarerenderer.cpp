@@ -0,0 +1,479 @@
+// Standard headers
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include <string>
+#include <iostream>
+#include <sstream>
+
+#include <algorithm>
+#include <vector>
+
+// Tetris headers
+#include "softwarerenderer.h"
+
+namespace tetris
+{
+  namespace
+  {
+    // The same layout as cStateGame, in the units of the 2D render mode where the screen is one unit high
+    const float BLOCK_SIZE = 0.015f;
+    const float BOARDS_X = 0.5f;
+    const float BOARDS_Y = 0.1f;
+    const float FULL_DETAIL_BOARD_WIDTH = 0.4f;
+    const float TEXT_X = 0.02f;
+    const float TEXT_Y = 0.2f;
+    const float TEXT_HEIGHT = 0.03f;
+    const float TEXT_PLAYER_SPACING = 0.05f;
+
+    const spitfire::math::cColour CLEAR_COLOUR(0.392156863f, 0.584313725f, 0.929411765f);
+
+    // 5x7 glyphs for digits and upper case letters, one byte per row with the left most pixel in bit 4
+    const size_t GLYPH_WIDTH = 5;
+    const size_t GLYPH_HEIGHT = 7;
+
+    const uint8_t GLYPHS_DIGITS[10][GLYPH_HEIGHT] = {
+      { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },
+      { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+      { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+      { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+      { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+      { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+      { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+      { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+      { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+      { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+    };
+
+    const uint8_t GLYPHS_LETTERS[26][GLYPH_HEIGHT] = {
+      { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+      { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E },
+      { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E },
+      { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C },
+      { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F },
+      { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 },
+      { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F },
+      { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 },
+      { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E },
+      { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C },
+      { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 },
+      { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F },
+      { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 },
+      { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 },
+      { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+      { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 },
+      { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D },
+      { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 },
+      { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E },
+      { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 },
+      { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E },
+      { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 },
+      { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A },
+      { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 },
+      { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 },
+      { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F },
+    };
+
+    // Returns nullptr for characters that we don't have a glyph for, they are drawn as spaces
+    const uint8_t* GetGlyph(char c)
+    {
+      if ((c >= '0') && (c <= '9')) return GLYPHS_DIGITS[c - '0'];
+      else if ((c >= 'A') && (c <= 'Z')) return GLYPHS_LETTERS[c - 'A'];
+      else if ((c >= 'a') && (c <= 'z')) return GLYPHS_LETTERS[c - 'a'];
+
+      return nullptr;
+    }
+
+    int ToPixels(float fUnits, size_t frameHeight)
+    {
+      return int(std::floor((fUnits * float(frameHeight)) + 0.5f));
+    }
+
+    uint8_t ScaleChannel(uint8_t value, float fScale, int iAdd)
+    {
+      const int result = int(float(value) * fScale) + iAdd;
+      return uint8_t(std::max(0, std::min(255, result)));
+    }
+  }
+
+
+  // ** cFrame
+
+  cFrame::cFrame() :
+    width(0),
+    height(0)
+  {
+  }
+
+  void cFrame::Resize(size_t _width, size_t _height)
+  {
+    width = _width;
+    height = _height;
+    pixels.resize(width * height, 0);
+  }
+
+  uint32_t cFrame::PackColour(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+  {
+    // Packed so that the bytes are in R, G, B, A order in memory on any platform
+    const uint8_t bytes[4] = { r, g, b, a };
+    uint32_t colour = 0;
+    std::memcpy(&colour, bytes, sizeof(colour));
+    return colour;
+  }
+
+  uint32_t cFrame::PackColour(const spitfire::math::cColour& colour)
+  {
+    return PackColour(uint8_t(std::max(0.0f, std::min(1.0f, colour.r)) * 255.0f), uint8_t(std::max(0.0f, std::min(1.0f, colour.g)) * 255.0f), uint8_t(std::max(0.0f, std::min(1.0f, colour.b)) * 255.0f), uint8_t(std::max(0.0f, std::min(1.0f, colour.a)) * 255.0f));
+  }
+
+  void cFrame::UnPackColour(uint32_t colour, uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a)
+  {
+    uint8_t bytes[4];
+    std::memcpy(bytes, &colour, sizeof(colour));
+    r = bytes[0];
+    g = bytes[1];
+    b = bytes[2];
+    a = bytes[3];
+  }
+
+  void cFrame::Clear(uint32_t colour)
+  {
+    std::fill(pixels.begin(), pixels.end(), colour);
+  }
+
+  void cFrame::FillRectangle(int x, int y, int rectangleWidth, int rectangleHeight, uint32_t colour)
+  {
+    // Clip to the frame
+    const int x0 = std::max(x, 0);
+    const int y0 = std::max(y, 0);
+    const int x1 = std::min(x + rectangleWidth, int(width));
+    const int y1 = std::min(y + rectangleHeight, int(height));
+    if ((x0 >= x1) || (y0 >= y1)) return;
+
+    for (int row = y0; row < y1; row++) {
+      uint32_t* pRow = &pixels[(size_t(row) * width) + size_t(x0)];
+      std::fill(pRow, pRow + (x1 - x0), colour);
+    }
+  }
+
+  void cFrame::Blit(const cFrame& source, int x, int y)
+  {
+    const int x0 = std::max(x, 0);
+    const int y0 = std::max(y, 0);
+    const int x1 = std::min(x + int(source.width), int(width));
+    const int y1 = std::min(y + int(source.height), int(height));
+    if ((x0 >= x1) || (y0 >= y1)) return;
+
+    for (int row = y0; row < y1; row++) {
+      const uint32_t* pSource = &source.pixels[(size_t(row - y) * source.width) + size_t(x0 - x)];
+      std::memcpy(&pixels[(size_t(row) * width) + size_t(x0)], pSource, size_t(x1 - x0) * sizeof(uint32_t));
+    }
+  }
+
+  void cFrame::WritePPM(std::ostream& o) const
+  {
+    o<<"P6\n"<<width<<" "<<height<<"\n255\n";
+
+    std::vector<uint8_t> row(3 * width);
+    for (size_t y = 0; y < height; y++) {
+      for (size_t x = 0; x < width; x++) {
+        uint8_t a = 0;
+        UnPackColour(pixels[(y * width) + x], row[(3 * x)], row[(3 * x) + 1], row[(3 * x) + 2], a);
+      }
+      o.write(reinterpret_cast<const char*>(&row[0]), row.size());
+    }
+  }
+
+
+  // ** cY4MWriter
+
+  cY4MWriter::cY4MWriter(std::ostream& _o) :
+    o(_o),
+    width(0),
+    height(0)
+  {
+  }
+
+  void cY4MWriter::WriteFrame(const cFrame& frame, size_t framesPerSecond)
+  {
+    if (width == 0) {
+      width = frame.GetWidth();
+      height = frame.GetHeight();
+      o<<"YUV4MPEG2 W"<<width<<" H"<<height<<" F"<<framesPerSecond<<":1 Ip A1:1 C444\n";
+    }
+
+    assert(frame.GetWidth() == width);
+    assert(frame.GetHeight() == height);
+
+    // BT.601 with the video range, the same as most encoders assume when there is no colour range in the header
+    const size_t n = width * height;
+    planes.resize(3 * n);
+    uint8_t* pY = &planes[0];
+    uint8_t* pU = &planes[n];
+    uint8_t* pV = &planes[2 * n];
+
+    const uint8_t* pRGBA = frame.GetData();
+    for (size_t i = 0; i < n; i++) {
+      const int r = pRGBA[(4 * i)];
+      const int g = pRGBA[(4 * i) + 1];
+      const int b = pRGBA[(4 * i) + 2];
+      pY[i] = uint8_t((((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16);
+      pU[i] = uint8_t((((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128);
+      pV[i] = uint8_t((((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128);
+    }
+
+    o<<"FRAME\n";
+    o.write(reinterpret_cast<const char*>(&planes[0]), planes.size());
+  }
+
+
+  // ** cSoftwareRenderer
+
+  cSoftwareRenderer::cBoardCache::cBoardCache() :
+    blockPixels(1),
+    bIsDirty(true)
+  {
+  }
+
+  cSoftwareRenderer::cSoftwareRenderer() :
+    layoutWidth(0),
+    layoutHeight(0)
+  {
+  }
+
+  void cSoftwareRenderer::SetPlayer(size_t i, const std::string& sName, const spitfire::math::cColour& colour)
+  {
+    if (i >= players.size()) players.resize(i + 1);
+
+    players[i].sName = sName;
+    players[i].colour = cFrame::PackColour(colour);
+
+    // The layout depends on the number of players
+    layoutWidth = 0;
+    layoutHeight = 0;
+  }
+
+  void cSoftwareRenderer::_UpdateLayout(const cGameSnapshot& snapshot, const cFrame& frame)
+  {
+    if ((frame.GetWidth() == layoutWidth) && (frame.GetHeight() == layoutHeight) && (snapshot.boards.size() == boards.size())) return;
+
+    layoutWidth = frame.GetWidth();
+    layoutHeight = frame.GetHeight();
+
+    boards.assign(snapshot.boards.size(), cBoardCache());
+    layout.clear();
+    if (snapshot.boards.empty()) return;
+
+    const cBoardSnapshot& board = snapshot.boards[0];
+    const float fScreenWidth = float(layoutWidth) / float(layoutHeight);
+    const spitfire::math::cVec2 boardSize(BLOCK_SIZE * float(board.GetWidth()), BLOCK_SIZE * float(board.GetHeight()));
+    const size_t nPlayers = std::max<size_t>(players.size(), 1);
+    LayoutBoards(snapshot.boards.size(), nPlayers, spitfire::math::cVec2(BOARDS_X, BOARDS_Y), spitfire::math::cVec2(fScreenWidth - (BOARDS_X + TEXT_X), 0.8f), boardSize, FULL_DETAIL_BOARD_WIDTH, layout);
+
+    // Blocks are a whole number of pixels so that every block is the same size
+    const size_t n = boards.size();
+    for (size_t i = 0; i < n; i++) boards[i].blockPixels = size_t(std::max(1, ToPixels(BLOCK_SIZE * layout[i].fScale, layoutHeight)));
+  }
+
+  void cSoftwareRenderer::_BuildPalette(const cBoardSnapshot& board)
+  {
+    const size_t n = board.GetColours();
+    palette.base.resize(n);
+    palette.light.resize(n);
+    palette.dark.resize(n);
+
+    for (size_t i = 0; i < n; i++) {
+      const uint32_t colour = cFrame::PackColour(board.GetColour(i));
+      uint8_t r = 0;
+      uint8_t g = 0;
+      uint8_t b = 0;
+      uint8_t a = 0;
+      cFrame::UnPackColour(colour, r, g, b, a);
+
+      palette.base[i] = colour;
+      palette.light[i] = cFrame::PackColour(ScaleChannel(r, 1.2f, 30), ScaleChannel(g, 1.2f, 30), ScaleChannel(b, 1.2f, 30), a);
+      palette.dark[i] = cFrame::PackColour(ScaleChannel(r, 0.6f, 0), ScaleChannel(g, 0.6f, 0), ScaleChannel(b, 0.6f, 0), a);
+    }
+  }
+
+  void cSoftwareRenderer::_RenderBlock(cFrame& frame, int x, int y, size_t blockPixels, int colour) const
+  {
+    assert(size_t(colour) < palette.base.size());
+
+    const int size = int(blockPixels);
+    frame.FillRectangle(x, y, size, size, palette.base[colour]);
+
+    // Small blocks are just flat squares
+    if (size < 4) return;
+
+    frame.FillRectangle(x, y, size, 1, palette.light[colour]);
+    frame.FillRectangle(x, y, 1, size, palette.light[colour]);
+    frame.FillRectangle(x, y + size - 1, size, 1, palette.dark[colour]);
+    frame.FillRectangle(x + size - 1, y, 1, size, palette.dark[colour]);
+  }
+
+  void cSoftwareRenderer::_RenderPiece(cFrame& frame, const cPiece& piece, int x, int y, size_t blockPixels) const
+  {
+    const size_t width = piece.GetWidth();
+    const size_t height = piece.GetHeight();
+    for (size_t _y = 0; _y < height; _y++) {
+      for (size_t px = 0; px < width; px++) {
+        // We want to add the blocks in upside down order
+        const size_t py = (height - 1) - _y;
+
+        const int c = piece.GetBlock(px, _y);
+        if (c != 0) _RenderBlock(frame, x + int(px * blockPixels), y + int(py * blockPixels), blockPixels, c);
+      }
+    }
+  }
+
+  void cSoftwareRenderer::_RenderBoardCache(cBoardCache& cache, const cBoardSnapshot& board)
+  {
+    const size_t width = board.GetWidth();
+    const size_t height = board.GetHeight();
+    const size_t blockPixels = cache.blockPixels;
+
+    cache.image.Resize(width * blockPixels, height * blockPixels);
+
+    for (size_t _y = 0; _y < height; _y++) {
+      // We want to add the blocks in upside down order
+      const size_t y = (height - 1) - _y;
+
+      for (size_t x = 0; x < width; x++) _RenderBlock(cache.image, int(x * blockPixels), int(y * blockPixels), blockPixels, board.GetBlock(x, _y));
+    }
+
+    cache.bIsDirty = false;
+  }
+
+  void cSoftwareRenderer::_RenderText(cFrame& frame, const std::string& sText, int x, int y, size_t glyphPixels, uint32_t colour) const
+  {
+    const int size = int(glyphPixels);
+
+    const size_t n = sText.length();
+    for (size_t i = 0; i < n; i++) {
+      const uint8_t* pGlyph = GetGlyph(sText[i]);
+      if (pGlyph != nullptr) {
+        for (size_t row = 0; row < GLYPH_HEIGHT; row++) {
+          for (size_t column = 0; column < GLYPH_WIDTH; column++) {
+            if ((pGlyph[row] & (0x10 >> column)) != 0) frame.FillRectangle(x + (int(column) * size), y + (int(row) * size), size, size, colour);
+          }
+        }
+      }
+
+      // One column of space between each character
+      x += int(GLYPH_WIDTH + 1) * size;
+    }
+  }
+
+  void cSoftwareRenderer::Render(const cGameSnapshot& snapshot, cFrame& frame)
+  {
+    assert(frame.GetWidth() != 0);
+    assert(frame.GetHeight() != 0);
+
+    _UpdateLayout(snapshot, frame);
+
+    frame.Clear(cFrame::PackColour(CLEAR_COLOUR));
+
+    if (snapshot.boards.empty()) return;
+
+    // Every board has the same colours
+    _BuildPalette(snapshot.boards[0]);
+
+    const size_t frameHeight = frame.GetHeight();
+
+    const size_t n = snapshot.boards.size();
+    for (size_t i = 0; i < n; i++) {
+      const cBoardSnapshot& board = snapshot.boards[i];
+      cBoardCache& cache = boards[i];
+
+      if (cache.bIsDirty) _RenderBoardCache(cache, board);
+
+      const int x = ToPixels(layout[i].position.x, frameHeight);
+      const int y = ToPixels(layout[i].position.y, frameHeight);
+      const size_t blockPixels = cache.blockPixels;
+
+      frame.Blit(cache.image, x, y);
+
+      if (board.IsPlaying()) _RenderPiece(frame, board.GetCurrentPiece(), x + int(board.GetCurrentPieceX() * blockPixels), y + int((board.GetHeight() - board.GetCurrentPieceY()) * blockPixels), blockPixels);
+
+      if (layout[i].detail == BOARD_DETAIL::FULL) {
+        const int nextPieceX = x + int((board.GetWidth() + 3) * blockPixels);
+        const int nextPieceY = y + int((board.GetHeight() * blockPixels) / 2);
+        _RenderPiece(frame, board.GetNextPiece(), nextPieceX, nextPieceY, blockPixels);
+      }
+    }
+
+    // Text for each player, the glyphs are 7 pixels high plus a gap of 2 between lines
+    const size_t glyphPixels = size_t(std::max(1, ToPixels(TEXT_HEIGHT / float(GLYPH_HEIGHT + 2), frameHeight)));
+    const int textX = ToPixels(TEXT_X, frameHeight);
+    float fTextY = TEXT_Y;
+
+    const size_t nPlayers = std::min(players.size(), n);
+    for (size_t i = 0; i < nPlayers; i++) {
+      const cBoardSnapshot& board = snapshot.boards[i];
+      const cPlayer& player = players[i];
+
+      _RenderText(frame, player.sName, textX, ToPixels(fTextY, frameHeight), glyphPixels, player.colour);
+      fTextY += TEXT_HEIGHT;
+
+      std::ostringstream o;
+      o<<"Level "<<board.GetLevel();
+      _RenderText(frame, o.str(), textX, ToPixels(fTextY, frameHeight), glyphPixels, player.colour);
+      fTextY += TEXT_HEIGHT;
+
+      o.str("");
+      o<<"Score "<<board.GetScore();
+      _RenderText(frame, o.str(), textX, ToPixels(fTextY, frameHeight), glyphPixels, player.colour);
+      fTextY += TEXT_HEIGHT;
+
+      fTextY += TEXT_PLAYER_SPACING;
+    }
+  }
+
+  void cSoftwareRenderer::_OnPieceMoved(const cBoardSnapshot& board)
+  {
+  }
+
+  void cSoftwareRenderer::_OnPieceRotated(const cBoardSnapshot& board)
+  {
+  }
+
+  void cSoftwareRenderer::_OnPieceChanged(const cBoardSnapshot& board)
+  {
+  }
+
+  void cSoftwareRenderer::_OnPieceHitsGround(const cBoardSnapshot& board)
+  {
+  }
+
+  void cSoftwareRenderer::_OnBoardChanged(const cBoardSnapshot& board)
+  {
+    // The cache is created on the first render
+    if (board.GetIndex() < boards.size()) boards[board.GetIndex()].bIsDirty = true;
+  }
+
+  void cSoftwareRenderer::_OnGameScoreTetris(const cBoardSnapshot& board, size_t uiScore)
+  {
+  }
+
+  void cSoftwareRenderer::_OnGameScoreOtherThanTetris(const cBoardSnapshot& board, size_t uiScore)
+  {
+  }
+
+  void cSoftwareRenderer::_OnGameNewLevel(const cBoardSnapshot& board, size_t uiLevel)
+  {
+  }
+
+  void cSoftwareRenderer::_OnGameOver(const cBoardSnapshot& board)
+  {
+  }
+
+  void cSoftwareRenderer::_OnLineCleared(const cBoardSnapshot& board, size_t row)
+  {
+  }
+
+  void cSoftwareRenderer::_OnLinesAdded(const cBoardSnapshot& board, size_t lines)
+  {
+  }
+}
@@ -0,0 +1,147 @@
+#ifndef TETRIS_SOFTWARERENDERER_H
+#define TETRIS_SOFTWARERENDERER_H
+
+// Standard headers
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Tetris headers
+#include "boardlayout.h"
+#include "tetris.h"
+
+namespace tetris
+{
+  // ** cFrame
+  //
+  // An RGBA image in memory with 8 bits per channel, rows go from the top down
+
+  class cFrame
+  {
+  public:
+    cFrame();
+
+    void Resize(size_t width, size_t height);
+
+    size_t GetWidth() const { return width; }
+    size_t GetHeight() const { return height; }
+
+    uint32_t GetPixel(size_t x, size_t y) const { return pixels[(y * width) + x]; }
+
+    // The pixels as R, G, B, A bytes
+    const uint8_t* GetData() const { return reinterpret_cast<const uint8_t*>(&pixels[0]); }
+
+    void Clear(uint32_t colour);
+    void FillRectangle(int x, int y, int rectangleWidth, int rectangleHeight, uint32_t colour);
+    void Blit(const cFrame& source, int x, int y);
+
+    // Binary PPM, the alpha channel is dropped
+    void WritePPM(std::ostream& o) const;
+
+    static uint32_t PackColour(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
+    static uint32_t PackColour(const spitfire::math::cColour& colour);
+    static void UnPackColour(uint32_t colour, uint8_t& r, uint8_t& g, uint8_t& b, uint8_t& a);
+
+  private:
+    size_t width;
+    size_t height;
+    std::vector<uint32_t> pixels;
+  };
+
+
+  // ** cY4MWriter
+  //
+  // Writes frames as an uncompressed YUV4MPEG2 stream with 4:4:4 sampling, which most video tools can read from a pipe
+
+  class cY4MWriter
+  {
+  public:
+    explicit cY4MWriter(std::ostream& o);
+
+    // Every frame must be the same size as the first one
+    void WriteFrame(const cFrame& frame, size_t framesPerSecond);
+
+  private:
+    std::ostream& o;
+
+    size_t width;
+    size_t height;
+
+    std::vector<uint8_t> planes; // Reused for each frame
+  };
+
+
+  // ** cSoftwareRenderer
+  //
+  // Draws the boards, pieces and player text into a cFrame on the CPU, with the same layout as cStateGame but without
+  // needing an OpenGL context.  Blocks are drawn as flat squares with a bevel instead of block.png and text uses a built
+  // in 5x7 font.  Like the render targets in cStateGame each board is cached and only redrawn after it changes.
+
+  class cSoftwareRenderer : public cView
+  {
+  public:
+    cSoftwareRenderer();
+
+    // The boards of the players are first and have text, any other boards are spectator boards
+    void SetPlayer(size_t i, const std::string& sName, const spitfire::math::cColour& colour);
+
+    void Render(const cGameSnapshot& snapshot, cFrame& frame);
+
+  private:
+    virtual void _OnPieceMoved(const cBoardSnapshot& board) override;
+    virtual void _OnPieceRotated(const cBoardSnapshot& board) override;
+    virtual void _OnPieceChanged(const cBoardSnapshot& board) override;
+    virtual void _OnPieceHitsGround(const cBoardSnapshot& board) override;
+    virtual void _OnBoardChanged(const cBoardSnapshot& board) override;
+    virtual void _OnGameScoreTetris(const cBoardSnapshot& board, size_t uiScore) override;
+    virtual void _OnGameScoreOtherThanTetris(const cBoardSnapshot& board, size_t uiScore) override;
+    virtual void _OnGameNewLevel(const cBoardSnapshot& board, size_t uiLevel) override;
+    virtual void _OnGameOver(const cBoardSnapshot& board) override;
+    virtual void _OnLineCleared(const cBoardSnapshot& board, size_t row) override;
+    virtual void _OnLinesAdded(const cBoardSnapshot& board, size_t lines) override;
+
+    struct cPlayer
+    {
+      std::string sName;
+      uint32_t colour;
+    };
+
+    // The colour of each colour index of a board along with the highlight and shadow of its bevel
+    struct cPalette
+    {
+      std::vector<uint32_t> base;
+      std::vector<uint32_t> light;
+      std::vector<uint32_t> dark;
+    };
+
+    struct cBoardCache
+    {
+      cBoardCache();
+
+      cFrame image;
+      size_t blockPixels;
+      bool bIsDirty;
+    };
+
+    void _UpdateLayout(const cGameSnapshot& snapshot, const cFrame& frame);
+    void _BuildPalette(const cBoardSnapshot& board);
+
+    void _RenderBlock(cFrame& frame, int x, int y, size_t blockPixels, int colour) const;
+    void _RenderPiece(cFrame& frame, const cPiece& piece, int x, int y, size_t blockPixels) const;
+    void _RenderBoardCache(cBoardCache& cache, const cBoardSnapshot& board);
+    void _RenderText(cFrame& frame, const std::string& sText, int x, int y, size_t glyphPixels, uint32_t colour) const;
+
+    std::vector<cPlayer> players;
+
+    // The layout is only worked out again when the size of the frame or the number of boards changes
+    size_t layoutWidth;
+    size_t layoutHeight;
+    std::vector<cBoardLayoutItem> layout;
+
+    cPalette palette;
+    std::vector<cBoardCache> boards;
+  };
+}
+
+#endif // TETRIS_SOFTWARERENDERER_H
@@ -43,6 +43,18 @@
 #include "application.h"
 #include "states.h"
 
+spitfire::math::cSpring<spitfire::math::cVec2> spring;
+
+namespace
+{
+  // The gui may have animations that we aren't told about, such as a blinking cursor, so even an idle screen is redrawn this often
+  const spitfire::durationms_t IDLE_REDRAW_MS = 500;
+
+  // Smaller movements of the spring than this are less than a pixel
+  const float HUD_OFFSET_EPSILON = 0.0005f;
+}
+
+
 // ** cState
 
 cState::cState(cApplication& _application) :
@@ -55,9 +67,18 @@ cState::cState(cApplication& _application) :
   pGuiRenderer(application.pGuiRenderer),
   pLayer(nullptr),
   bIsWireframe(false),
+  bIsDirty(true),
+  lastRedrawTime(0),
+  bIsLetterBoxUsingViewport(true),
+  fRenderScale(1.0f),
   pFrameBufferObjectLetterBoxedRectangle(nullptr),
+  textureWidthLetterBoxedRectangle(0),
+  textureHeightLetterBoxedRectangle(0),
   pShaderLetterBoxedRectangle(nullptr)
 {
+  bIsLetterBoxUsingViewport = (settings.GetLetterBoxMode() != TEXT("texture"));
+  fRenderScale = std::max(0.25f, std::min(settings.GetRenderScale(), 1.0f));
+
   breathe::gui::cLayer* pRoot = static_cast<breathe::gui::cLayer*>(pGuiManager->GetRoot());
 
   pLayer = new breathe::gui::cLayer;
@@ -80,10 +101,14 @@ cState::~cState()
 void cState::_OnPause()
 {
   if (pLayer != nullptr) pLayer->SetVisible(false);
+
+  SetDirty();
 }
 
 void cState::_OnResume()
 {
+  SetDirty();
+
   if (pLayer != nullptr) {
     pLayer->SetVisible(true);
 
@@ -93,6 +118,8 @@ void cState::_OnResume()
 
 void cState::_OnKeyboardEvent(const breathe::gui::cKeyboardEvent& event)
 {
+  SetDirty();
+
   bool bIsHandled = false;
   if (event.IsKeyDown()) bIsHandled = pGuiManager->InjectEventKeyboardDown(event.GetKeyCode());
   else bIsHandled = pGuiManager->InjectEventKeyboardUp(event.GetKeyCode());
@@ -102,6 +129,8 @@ void cState::_OnKeyboardEvent(const breathe::gui::cKeyboardEvent& event)
 
 void cState::_OnMouseEvent(const breathe::gui::cMouseEvent& event)
 {
+  SetDirty();
+
   const float x = event.GetX() / pContext->GetWidth();
   const float y = event.GetY() / pContext->GetHeight();
 
@@ -115,12 +144,38 @@ void cState::_OnMouseEvent(const breathe::gui::cMouseEvent& event)
 
   void cState::_OnJoystickEvent(const breathe::util::cJoystickEvent& event)
   {
+    SetDirty();
+
     bool bIsHandled = false;
     if (event.IsButtonDown()) bIsHandled = pGuiManager->InjectEventJoystickEvent(event);
 
     if (!bIsHandled) _OnStateJoystickEvent(event);
   }
 
+void cState::UpdateGui(const spitfire::math::cTimeStep& timeStep)
+{
+  // The spring uses the average frame time so that the shaking doesn't jitter with the frame times
+  const spitfire::math::cTimeStep smoothedTimeStep(timeStep.GetCurrentTimeMS(), application.framePacer.GetSmoothedFrameDurationMS());
+
+  // Update the hud offset to shake the gui
+  spring.Update(smoothedTimeStep);
+
+  const spitfire::math::cVec2 hudOffset = spring.GetPosition();
+  pGuiManager->SetHUDOffset(hudOffset);
+
+  if ((fabs(hudOffset.x - hudOffsetDrawn.x) > HUD_OFFSET_EPSILON) || (fabs(hudOffset.y - hudOffsetDrawn.y) > HUD_OFFSET_EPSILON)) {
+    hudOffsetDrawn = hudOffset;
+    SetDirty();
+  }
+
+  pGuiRenderer->Update();
+}
+
+spitfire::durationms_t cState::_GetMaximumIdleWait() const
+{
+  return IDLE_REDRAW_MS;
+}
+
 breathe::gui::cStaticText* cState::AddStaticText(breathe::gui::id_t id, const spitfire::string_t& sText, float x, float y, float width)
 {
   breathe::gui::cStaticText* pStaticText = new breathe::gui::cStaticText;
@@ -203,11 +258,16 @@ void cState::CreateVertexBufferObjectLetterBoxedRectangle(size_t width, size_t h
   const float fWidth = float(letterBox.letterBoxedWidth);
   const float fHeight = float(letterBox.letterBoxedHeight);
 
+  // The texture is smaller than the rectangle if we are rendering at a lower resolution
+  size_t textureWidth = 0;
+  size_t textureHeight = 0;
+  GetRenderToTextureSize(width, height, textureWidth, textureHeight);
+
   // Texture coordinates
   // NOTE: The v coordinates have been swapped, the code looks correct but with normal v coordinates the gui is rendered upside down
   const float fU = 0.0f;
-  const float fV = float(letterBox.letterBoxedHeight);
-  const float fU2 = float(letterBox.letterBoxedWidth);
+  const float fV = float(textureHeight);
+  const float fU2 = float(textureWidth);
   const float fV2 = 0.0f;
 
   const float x = 0.0f;
@@ -237,9 +297,29 @@ void cState::CreateFrameBufferObjectLetterBoxedRectangle(size_t width, size_t he
 {
   ASSERT(pFrameBufferObjectLetterBoxedRectangle == nullptr);
 
-  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
+  size_t textureWidth = 0;
+  size_t textureHeight = 0;
+  GetRenderToTextureSize(width, height, textureWidth, textureHeight);
 
-  pFrameBufferObjectLetterBoxedRectangle = pContext->CreateTextureFrameBufferObjectNoMipMaps(letterBox.letterBoxedWidth, letterBox.letterBoxedHeight, opengl::PIXELFORMAT::R8G8B8A8);
+  pFrameBufferObjectLetterBoxedRectangle = pContext->CreateTextureFrameBufferObjectNoMipMaps(textureWidth, textureHeight, opengl::PIXELFORMAT::R8G8B8A8);
+  textureWidthLetterBoxedRectangle = textureWidth;
+  textureHeightLetterBoxedRectangle = textureHeight;
+}
+
+void cState::ResizeFrameBufferObjectLetterBoxedRectangle(size_t width, size_t height)
+{
+  ASSERT(pFrameBufferObjectLetterBoxedRectangle != nullptr);
+
+  size_t textureWidth = 0;
+  size_t textureHeight = 0;
+  GetRenderToTextureSize(width, height, textureWidth, textureHeight);
+
+  // Growing the window along the letter box bars doesn't change the size of the letter boxed rectangle
+  if ((textureWidth == textureWidthLetterBoxedRectangle) && (textureHeight == textureHeightLetterBoxedRectangle)) return;
+
+  // The frame buffer object can't change size so it is destroyed and created again at the new size, nothing is loaded from disk
+  DestroyFrameBufferObjectLetterBoxedRectangle();
+  CreateFrameBufferObjectLetterBoxedRectangle(width, height);
 }
 
 void cState::DestroyFrameBufferObjectLetterBoxedRectangle()
@@ -265,15 +345,56 @@ void cState::DestroyShaderLetterBoxedRectangle()
   }
 }
 
+bool cState::IsRenderingToTexture(size_t width, size_t height) const
+{
+  if (fRenderScale < 1.0f) return true;
+
+  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
+
+  if ((width == letterBox.desiredWidth) || (height == letterBox.desiredHeight)) return false;
+
+  return !bIsLetterBoxUsingViewport;
+}
+
+void cState::GetRenderToTextureSize(size_t width, size_t height, size_t& textureWidth, size_t& textureHeight) const
+{
+  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
+
+  textureWidth = std::max<size_t>(1, size_t((fRenderScale * float(letterBox.letterBoxedWidth)) + 0.5f));
+  textureHeight = std::max<size_t>(1, size_t((fRenderScale * float(letterBox.letterBoxedHeight)) + 0.5f));
+}
+
 void cState::LoadResources()
 {
   const size_t width = pContext->GetWidth();
   const size_t height = pContext->GetHeight();
+
+  SetDirty();
+
+  // Rendering straight to the screen doesn't need any of the letter box resources
+  if (!IsRenderingToTexture(width, height)) return;
+
   CreateFrameBufferObjectLetterBoxedRectangle(width, height);
   CreateShaderLetterBoxedRectangle();
   CreateVertexBufferObjectLetterBoxedRectangle(width, height);
 }
 
+void cState::ResizeResources()
+{
+  const size_t width = pContext->GetWidth();
+  const size_t height = pContext->GetHeight();
+
+  SetDirty();
+
+  // The shader doesn't depend on the size so it is kept, anything that hasn't been created yet is created when it is first drawn
+  if (pFrameBufferObjectLetterBoxedRectangle != nullptr) ResizeFrameBufferObjectLetterBoxedRectangle(width, height);
+
+  if (vertexBufferObjectLetterBoxedRectangle.IsCompiled()) {
+    DestroyVertexBufferObjectLetterBoxedRectangle();
+    CreateVertexBufferObjectLetterBoxedRectangle(width, height);
+  }
+}
+
 void cState::DestroyResources()
 {
   DestroyFrameBufferObjectLetterBoxedRectangle();
@@ -283,12 +404,30 @@ void cState::DestroyResources()
 
 void cState::_Render(const spitfire::math::cTimeStep& timeStep)
 {
+  const spitfire::durationms_t currentTime = SDL_GetTicks();
+  const spitfire::durationms_t timeSinceRedraw = currentTime - lastRedrawTime;
+  if (!bIsDirty && (timeSinceRedraw < IDLE_REDRAW_MS)) {
+    // Nothing has changed so the last frame is left on the screen and we sleep until there is an event for the main loop
+    // to handle.  The event is left in the queue.
+    const spitfire::durationms_t wait = std::min(_GetMaximumIdleWait(), IDLE_REDRAW_MS - timeSinceRedraw);
+    if (wait != 0) SDL_WaitEventTimeout(nullptr, int(wait));
+
+    // The time we spent waiting is not a frame
+    application.framePacer.Reset();
+    return;
+  }
+
+  // Cleared before drawing so that anything that is left for a later frame can make the state dirty again
+  bIsDirty = false;
+  lastRedrawTime = currentTime;
+
   const size_t width = pContext->GetWidth();
   const size_t height = pContext->GetHeight();
 
   spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
 
-  if ((width == letterBox.desiredWidth) || (height == letterBox.desiredHeight)) {
+  if (IsRenderingToTexture(width, height)) _RenderToScreenLetterBoxedTexture(timeStep, width, height);
+  else if ((width == letterBox.desiredWidth) || (height == letterBox.desiredHeight)) {
     // Render the scene
     const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
     pContext->SetClearColour(clearColour);
@@ -300,86 +439,125 @@ void cState::_Render(const spitfire::math::cTimeStep& timeStep)
       _RenderToTexture(timeStep);
 
     pContext->EndRenderToScreen(*pWindow);
-  } else {
-    // Render the scene to a texture and draw the texture to the screen letter boxed
+  } else _RenderToScreenLetterBoxedViewport(timeStep, width, height);
+
+  // Wait until it is time to start the next frame
+  application.framePacer.WaitForNextFrame();
+}
 
-    if (!vertexBufferObjectLetterBoxedRectangle.IsCompiled()) CreateVertexBufferObjectLetterBoxedRectangle(width, height);
-    if (pFrameBufferObjectLetterBoxedRectangle == nullptr) CreateFrameBufferObjectLetterBoxedRectangle(width, height);
-    if (pShaderLetterBoxedRectangle == nullptr) CreateShaderLetterBoxedRectangle();
+void cState::_RenderToScreenLetterBoxedViewport(const spitfire::math::cTimeStep& timeStep, size_t width, size_t height)
+{
+  // Render the scene straight to the screen with the viewport and scissor limited to the letter boxed rectangle, which
+  // saves switching render targets and copying the whole screen every frame
+  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
 
-    // Render the scene to the texture
-    {
-      const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
-      pContext->SetClearColour(clearColour);
+  const GLint x = GLint((width - letterBox.letterBoxedWidth) / 2);
+  const GLint y = GLint((height - letterBox.letterBoxedHeight) / 2);
+  const GLsizei letterBoxedWidth = GLsizei(letterBox.letterBoxedWidth);
+  const GLsizei letterBoxedHeight = GLsizei(letterBox.letterBoxedHeight);
 
-      pContext->BeginRenderToTexture(*pFrameBufferObjectLetterBoxedRectangle);
+  // The bars
+  const spitfire::math::cColour clearColourBars(0.0f, 0.0f, 0.0f);
+  pContext->SetClearColour(clearColourBars);
 
-        if (bIsWireframe) pContext->EnableWireframe();
+  pContext->BeginRenderToScreen();
 
-        _RenderToTexture(timeStep);
+    glViewport(x, y, letterBoxedWidth, letterBoxedHeight);
+    glScissor(x, y, letterBoxedWidth, letterBoxedHeight);
+    glEnable(GL_SCISSOR_TEST);
 
-      pContext->EndRenderToTexture(*pFrameBufferObjectLetterBoxedRectangle);
-    }
+    // The scene
+    const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
+    glClearColor(clearColour.r, clearColour.g, clearColour.b, clearColour.a);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Render the texture to the screen
-    {
-      const spitfire::math::cColour clearColour(1.0f, 0.0f, 0.0f);
-      pContext->SetClearColour(clearColour);
+    if (bIsWireframe) pContext->EnableWireframe();
+
+    _RenderToTexture(timeStep);
+
+    glDisable(GL_SCISSOR_TEST);
+    glViewport(0, 0, GLsizei(width), GLsizei(height));
+
+  pContext->EndRenderToScreen(*pWindow);
+}
+
+void cState::_RenderToScreenLetterBoxedTexture(const spitfire::math::cTimeStep& timeStep, size_t width, size_t height)
+{
+  // Render the scene to a texture, possibly at a lower resolution, and draw the texture to the screen letter boxed
+  spitfire::math::cLetterBox letterBox(TETRIS_VIDEO_TARGET_WIDTH, TETRIS_VIDEO_TARGET_HEIGHT, width, height);
 
-      pContext->BeginRenderToScreen();
+  if (!vertexBufferObjectLetterBoxedRectangle.IsCompiled()) CreateVertexBufferObjectLetterBoxedRectangle(width, height);
+  if (pFrameBufferObjectLetterBoxedRectangle == nullptr) CreateFrameBufferObjectLetterBoxedRectangle(width, height);
+  if (pShaderLetterBoxedRectangle == nullptr) CreateShaderLetterBoxedRectangle();
 
-        //if (bIsWireframe) pContext->EnableWireframe();
+  // Render the scene to the texture
+  {
+    const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
+    pContext->SetClearColour(clearColour);
 
-        pContext->BeginRenderMode2D(opengl::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN);
+    pContext->BeginRenderToTexture(*pFrameBufferObjectLetterBoxedRectangle);
 
-          {
-            // Set the position of the layer
-            spitfire::math::cMat4 matModelView2D;
-            if (letterBox.fRatio < letterBox.fDesiredRatio) matModelView2D.SetTranslation(0.0f, float((height - letterBox.letterBoxedHeight) / 2), 0.0f);
-            else matModelView2D.SetTranslation(float((width - letterBox.letterBoxedWidth) / 2), 0.0f, 0.0f);
+      if (bIsWireframe) pContext->EnableWireframe();
 
-            pContext->EnableBlending();
+      _RenderToTexture(timeStep);
 
-            pContext->BindTexture(0, *pFrameBufferObjectLetterBoxedRectangle);
+    pContext->EndRenderToTexture(*pFrameBufferObjectLetterBoxedRectangle);
+  }
 
-            pContext->BindShader(*pShaderLetterBoxedRectangle);
+  // Render the texture to the screen
+  {
+    const spitfire::math::cColour clearColour(1.0f, 0.0f, 0.0f);
+    pContext->SetClearColour(clearColour);
 
-            pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(opengl::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_DIMENSIONS_AND_ASPECT_RATIO, matModelView2D);
+    pContext->BeginRenderToScreen();
 
-            pContext->BindStaticVertexBufferObject2D(vertexBufferObjectLetterBoxedRectangle);
-            pContext->DrawStaticVertexBufferObjectTriangles2D(vertexBufferObjectLetterBoxedRectangle);
-            pContext->UnBindStaticVertexBufferObject2D(vertexBufferObjectLetterBoxedRectangle);
+      //if (bIsWireframe) pContext->EnableWireframe();
 
-            pContext->UnBindShader(*pShaderLetterBoxedRectangle);
+      pContext->BeginRenderMode2D(opengl::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN);
 
-            pContext->UnBindTexture(0, *pFrameBufferObjectLetterBoxedRectangle);
+        {
+          // Set the position of the layer
+          spitfire::math::cMat4 matModelView2D;
+          if (letterBox.fRatio < letterBox.fDesiredRatio) matModelView2D.SetTranslation(0.0f, float((height - letterBox.letterBoxedHeight) / 2), 0.0f);
+          else matModelView2D.SetTranslation(float((width - letterBox.letterBoxedWidth) / 2), 0.0f, 0.0f);
 
-            pContext->DisableBlending();
-          }
+          pContext->EnableBlending();
 
-        pContext->EndRenderMode2D();
+          pContext->BindTexture(0, *pFrameBufferObjectLetterBoxedRectangle);
 
-      pContext->EndRenderToScreen(*pWindow);
-    }
+          pContext->BindShader(*pShaderLetterBoxedRectangle);
+
+          pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(opengl::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_DIMENSIONS_AND_ASPECT_RATIO, matModelView2D);
+
+          pContext->BindStaticVertexBufferObject2D(vertexBufferObjectLetterBoxedRectangle);
+          pContext->DrawStaticVertexBufferObjectTriangles2D(vertexBufferObjectLetterBoxedRectangle);
+          pContext->UnBindStaticVertexBufferObject2D(vertexBufferObjectLetterBoxedRectangle);
+
+          pContext->UnBindShader(*pShaderLetterBoxedRectangle);
+
+          pContext->UnBindTexture(0, *pFrameBufferObjectLetterBoxedRectangle);
+
+          pContext->DisableBlending();
+        }
+
+      pContext->EndRenderMode2D();
+
+    pContext->EndRenderToScreen(*pWindow);
   }
 }
 
 
 // ** cBoardRepresentation
 
-cBoardRepresentation::cBoardRepresentation(tetris::cBoard& _board, const spitfire::string_t& _sName) :
-  board(_board),
+cBoardRepresentation::cBoardRepresentation(size_t _index, const spitfire::string_t& _sName) :
+  index(_index),
   sName(_sName),
-
-  bIsInputPieceMoveLeft(false),
-  bIsInputPieceMoveRight(false),
-  bIsInputPieceRotateCounterClockWise(false),
-  bIsInputPieceRotateClockWise(false),
-  bIsInputPieceDropOneRow(false),
-  bIsInputPieceDropToGround(false),
-
-  lastKeyLeft(0),
-  lastKeyRight(0)
+  fScale(1.0f),
+  detail(BOARD_DETAIL::FULL),
+  bIsRenderTargetDirty(true),
+  bIsPieceInRenderTarget(false),
+  pieceXInRenderTarget(0),
+  pieceYInRenderTarget(0)
 {
 }
 
@@ -489,9 +667,6 @@ bool cHighScoresTable::SubmitEntry(const spitfire::string_t& sName, size_t score
 }
 
 
-spitfire::math::cSpring<spitfire::math::cVec2> spring;
-
-
 // ** cStateMenu
 
 cStateMenu::cStateMenu(cApplication& application) :
@@ -572,12 +747,7 @@ cStateMenu::cStateMenu(cApplication& application) :
 
 void cStateMenu::_Update(const spitfire::math::cTimeStep& timeStep)
 {
-  // Update the hud offset to shake the gui
-  spring.Update(timeStep);
-
-  pGuiManager->SetHUDOffset(spring.GetPosition());
-
-  pGuiRenderer->Update();
+  UpdateGui(timeStep);
 }
 
 
@@ -836,12 +1006,7 @@ breathe::gui::EVENT_RESULT cStateNewGame::_OnWidgetEvent(const breathe::gui::cWi
 
 void cStateNewGame::_Update(const spitfire::math::cTimeStep& timeStep)
 {
-  // Update the hud offset to shake the gui
-  spring.Update(timeStep);
-
-  pGuiManager->SetHUDOffset(spring.GetPosition());
-
-  pGuiRenderer->Update();
+  UpdateGui(timeStep);
 }
 
 void cStateNewGame::_RenderToTexture(const spitfire::math::cTimeStep& timeStep)
@@ -944,12 +1109,7 @@ breathe::gui::EVENT_RESULT cStateHighScores::_OnWidgetEvent(const breathe::gui::
 
 void cStateHighScores::_Update(const spitfire::math::cTimeStep& timeStep)
 {
-  // Update the hud offset to shake the gui
-  spring.Update(timeStep);
-
-  pGuiManager->SetHUDOffset(spring.GetPosition());
-
-  pGuiRenderer->Update();
+  UpdateGui(timeStep);
 }
 
 void cStateHighScores::_UpdateInput(const spitfire::math::cTimeStep& timeStep)
@@ -1025,12 +1185,7 @@ cStatePauseMenu::cStatePauseMenu(cApplication& application, cStateGame& _parentS
 
 void cStatePauseMenu::_Update(const spitfire::math::cTimeStep& timeStep)
 {
-  // Update the hud offset to shake the gui
-  spring.Update(timeStep);
-
-  pGuiManager->SetHUDOffset(spring.GetPosition());
-
-  pGuiRenderer->Update();
+  UpdateGui(timeStep);
 }
 
 void cStatePauseMenu::_OnStateKeyboardEvent(const breathe::gui::cKeyboardEvent& event)
@@ -1075,56 +1230,148 @@ void cStatePauseMenu::_RenderToTexture(const spitfire::math::cTimeStep& timeStep
 }
 
 
+namespace
+{
+  // Render target resolution for each level of detail
+  const size_t FULL_DETAIL_TEXELS_PER_BLOCK = 32;
+  const size_t LOW_DETAIL_TEXELS_PER_BLOCK = 4;
+
+  size_t GetTexelsPerBlock(BOARD_DETAIL detail)
+  {
+    return (detail == BOARD_DETAIL::FULL) ? FULL_DETAIL_TEXELS_PER_BLOCK : LOW_DETAIL_TEXELS_PER_BLOCK;
+  }
+
+  // Low detail boards are redrawn at most once every this many frames, each board is on a different frame so that only a
+  // few are redrawn at a time
+  const size_t LOW_DETAIL_UPDATE_FRAMES = 6;
+
+  // The most flashing blocks that are drawn at once
+  const size_t MAX_EFFECT_QUADS = 256;
+
+  // Enough for a tetris on every board of a big spectator game at once
+  const size_t MAX_PARTICLES = 65536;
+  const size_t PARTICLES_PER_BLOCK = 16;
+  const size_t PARTICLES_PER_BLOCK_TETRIS = 48;
+}
+
 // ** cStateGame
 
 cStateGame::cStateGame(cApplication& application) :
   cState(application),
 
+  pProfilingText(nullptr),
+
   pTextureBlock(nullptr),
 
   pShaderBlock(nullptr),
+  pShaderBlockInstanced(nullptr),
+  pShaderBoardTexture(nullptr),
+  pShaderParticle(nullptr),
 
-  game(*this),
+  blockRenderMode(BLOCK_RENDERER::INSTANCED),
+  pieceRenderMode(BLOCK_RENDERER::INSTANCED),
+
+  nPlayers(1),
+  nFrame(0),
+
+  particlesUpdated(std::chrono::steady_clock::now()),
+  bIsProfiling(false),
+
+  inputMapper(simulation),
 
   bPauseSoon(false),
   bQuitSoon(false)
 {
   pTextureBlock = pContext->CreateTexture(TEXT("data/textures/block.png"));
 
-  pShaderBlock = pContext->CreateShader(TEXT("data/shaders/passthroughwithcolour.vert"), TEXT("data/shaders/passthroughwithcolour.frag"));
+  pShaderBlock = pContext->CreateShader(TEXT("data/shaders/blockgeometry.vert"), TEXT("data/shaders/passthroughwithcolour.frag"));
 
-  const spitfire::durationms_t currentTime = SDL_GetTicks();
+  blockRenderMode = GetBlockRendererFromName(settings.GetBlockRenderer());
+  pieceRenderMode = (blockRenderMode == BLOCK_RENDERER::GEOMETRY) ? BLOCK_RENDERER::GEOMETRY : BLOCK_RENDERER::INSTANCED;
+  if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+    pShaderBlockInstanced = pContext->CreateShader(TEXT("data/shaders/blockinstanced.vert"), TEXT("data/shaders/passthroughwithcolour.frag"));
+  }
+  if (blockRenderMode == BLOCK_RENDERER::TEXTURE) {
+    pShaderBoardTexture = pContext->CreateShader(TEXT("data/shaders/blockboard.vert"), TEXT("data/shaders/blockboard.frag"));
+  }
 
-  spitfire::math::SetRandomSeed(currentTime);
+  pShaderParticle = pContext->CreateShader(TEXT("data/shaders/particle.vert"), TEXT("data/shaders/passthroughwithcolour.frag"));
 
-  game.boards.push_back(new tetris::cBoard(game));
-  if (settings.GetNumberOfPlayers() != 1) game.boards.push_back(new tetris::cBoard(game));
+  blockRenderer.Create();
+  blockRenderer.CreatePieceGeometryBuffer(effectGeometry, MAX_EFFECT_QUADS);
+  particles.Create(MAX_PARTICLES);
 
-  game.StartGame(currentTime);
+  const spitfire::durationms_t currentTime = SDL_GetTicks();
 
-  //const tetris::cBoard& board = *(game.boards[0]);
-  //width = board.GetWidth();
-  //height = board.GetHeight();
+  nPlayers = (settings.GetNumberOfPlayers() != 1) ? 2 : 1;
+  const size_t nBoards = nPlayers + settings.GetNumberOfSpectatorBoards();
+  simulation.StartGame(nBoards, currentTime);
+
+  const tetris::cGameSnapshot& snapshot = simulation.GetSnapshot();
+
+  // Every board has the same pieces and colours so they can all share one cache
+  if (!snapshot.boards.empty()) blockRenderer.CreatePieceMeshCache(pieceMeshCache, pieceRenderMode, simulation.GetPossiblePieces(), snapshot.boards[0], spitfire::math::cVec2(0.015f, 0.015f));
 
   //scale.Set(0.2f, 0.2f, 10.0f);
 
-  for (size_t i = 0; i < game.boards.size(); i++) {
-    tetris::cBoard& board = *(game.boards[i]);
+  // The players' boards are at full size, any others fill the rest of the screen to the right of them.  The 2D render
+  // mode keeps the aspect ratio so the screen is one unit high.
+  std::vector<cBoardLayoutItem> layout;
+  if (!snapshot.boards.empty()) {
+    const float fScreenWidth = float(TETRIS_VIDEO_TARGET_WIDTH) / float(TETRIS_VIDEO_TARGET_HEIGHT);
+    const spitfire::math::cVec2 boardSize(0.015f * float(snapshot.boards[0].GetWidth()), 0.015f * float(snapshot.boards[0].GetHeight()));
+    LayoutBoards(snapshot.boards.size(), nPlayers, spitfire::math::cVec2(0.5f, 0.1f), spitfire::math::cVec2(fScreenWidth - 0.52f, 0.8f), boardSize, 0.4f, layout);
+  }
+
+  // Every board's render target is a rectangle of one texture so that all the boards are drawn without changing texture.
+  // If the texture would be too big for the driver then every board is packed again at half the resolution, at one texel
+  // per block anything fits.
+  for (size_t divisor = 1; !snapshot.boards.empty(); divisor *= 2) {
+    for (size_t i = 0; i < snapshot.boards.size(); i++) {
+      const tetris::cBoardSnapshot& board = snapshot.boards[i];
+      const size_t nTexelsPerBlock = std::max<size_t>(1, GetTexelsPerBlock(layout[i].detail) / divisor);
+      boardRenderTargetAtlas.Add(nTexelsPerBlock * board.GetWidth(), nTexelsPerBlock * board.GetHeight());
+    }
+
+    if (blockRenderer.CreateBoardRenderTargetAtlas(boardRenderTargetAtlas)) break;
 
-    cBoardRepresentation* pBoardRepresentation = new cBoardRepresentation(board, settings.GetPlayerName(i));
+    // Start the packing again
+    blockRenderer.DestroyBoardRenderTargetAtlas(boardRenderTargetAtlas);
 
-    pContext->CreateStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectBoardTriangles);
-    UpdateBoardVBO(pBoardRepresentation->vertexBufferObjectBoardTriangles, board);
+    const bool bIsSmallest = (GetTexelsPerBlock(BOARD_DETAIL::FULL) / divisor) <= 1;
+    if (bIsSmallest) {
+      std::cout<<"cStateGame::cStateGame Unable to create the board render target atlas"<<std::endl;
+      break;
+    }
+
+    std::cout<<"cStateGame::cStateGame Packing the board render targets at a lower resolution"<<std::endl;
+  }
+
+  // Without the atlas there is nowhere to draw the boards so no board representations are created and we go back to the menu
+  const bool bIsAtlasValid = boardRenderTargetAtlas.IsValid();
+  if (!bIsAtlasValid) {
+    std::cout<<"cStateGame::cStateGame Unable to draw the boards, returning to the menu"<<std::endl;
+    bQuitSoon = true;
+  }
+
+  for (size_t i = 0; bIsAtlasValid && (i < snapshot.boards.size()); i++) {
+    const tetris::cBoardSnapshot& board = snapshot.boards[i];
 
-    pContext->CreateStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectPieceTriangles);
-    UpdatePieceVBO(pBoardRepresentation->vertexBufferObjectPieceTriangles, board, board.GetCurrentPiece());
+    // Only the players have names in the settings
+    const spitfire::string_t sName = (i < nPlayers) ? settings.GetPlayerName(i) : TEXT("Spectator");
 
-    pContext->CreateStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectNextPieceTriangles);
-    UpdatePieceVBO(pBoardRepresentation->vertexBufferObjectNextPieceTriangles, board, board.GetNextPiece());
+    cBoardRepresentation* pBoardRepresentation = new cBoardRepresentation(i, sName);
+    pBoardRepresentation->position = layout[i].position;
+    pBoardRepresentation->fScale = layout[i].fScale;
+    pBoardRepresentation->detail = layout[i].detail;
+
+    CreateBoardRepresentation(*pBoardRepresentation, board);
 
     boardRepresentations.push_back(pBoardRepresentation);
   }
 
+  AddInputBindings(nPlayers);
+
 
   const spitfire::math::cColour red(1.0f, 0.0f, 0.0f);
   const spitfire::math::cColour green(0.0f, 1.0f, 0.0f);
@@ -1136,7 +1383,7 @@ cStateGame::cStateGame(cApplication& application) :
   float y = 0.2f;
   const float width = 0.4f;
 
-  for (size_t i = 0; i < game.boards.size(); i++) {
+  for (size_t i = 0; i < nPlayers; i++) {
     const spitfire::string_t sColour = settings.GetPlayerColour(i);
     spitfire::math::cColour colour = red;
     if (sColour == TEXT("Green")) colour = green;
@@ -1160,6 +1407,9 @@ cStateGame::cStateGame(cApplication& application) :
     y += 0.05f;
   }
 
+  // Empty until profiling is turned on
+  pProfilingText = AddStaticText(0, TEXT(""), x, 0.95f, 2.0f * width);
+
   UpdateText();
 
 
@@ -1178,18 +1428,41 @@ cStateGame::~cStateGame()
 {
   std::cout<<"cStateGame::~cStateGame"<<std::endl;
 
+  simulation.StopGame();
+
+  // Keep the last game so that it can be turned into a video with --export-video
+  const spitfire::string_t sReplayFilePath = spitfire::filesystem::GetThisApplicationSettingsDirectory() + TEXT("last.replay");
+  simulation.GetReplay().Save(spitfire::string::ToUTF8(sReplayFilePath));
+
   const size_t n = boardRepresentations.size();
   for (size_t i = 0; i < n; i++) {
     cBoardRepresentation* pBoardRepresentation = boardRepresentations[i];
-    pContext->DestroyStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectNextPieceTriangles);
-    pContext->DestroyStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectPieceTriangles);
-    pContext->DestroyStaticVertexBufferObject(pBoardRepresentation->vertexBufferObjectBoardTriangles);
+    DestroyBoardRepresentation(*pBoardRepresentation);
     spitfire::SAFE_DELETE(pBoardRepresentation);
   }
 
   boardRepresentations.clear();
 
-  game.boards.clear();
+  particles.Destroy();
+  blockRenderer.DestroyPieceGeometryBuffer(effectGeometry);
+  blockRenderer.DestroyBoardRenderTargetAtlas(boardRenderTargetAtlas);
+  blockRenderer.DestroyPieceMeshCache(pieceMeshCache);
+  blockRenderer.Destroy();
+
+  if (pShaderParticle != nullptr) {
+    pContext->DestroyShader(pShaderParticle);
+    pShaderParticle = nullptr;
+  }
+
+  if (pShaderBoardTexture != nullptr) {
+    pContext->DestroyShader(pShaderBoardTexture);
+    pShaderBoardTexture = nullptr;
+  }
+
+  if (pShaderBlockInstanced != nullptr) {
+    pContext->DestroyShader(pShaderBlockInstanced);
+    pShaderBlockInstanced = nullptr;
+  }
 
   if (pShaderBlock != nullptr) {
     pContext->DestroyShader(pShaderBlock);
@@ -1205,15 +1478,95 @@ cStateGame::~cStateGame()
   std::cout<<"cStateGame::~cStateGame returning"<<std::endl;
 }
 
+void cStateGame::_OnPause()
+{
+  cState::_OnPause();
+
+  // The pause menu gets the key and button up events from now on so we release everything ourselves
+  inputMapper.ReleaseAll(std::chrono::steady_clock::now());
+
+  // Stop gravity while the pause menu is shown
+  simulation.Pause();
+}
+
+void cStateGame::_OnResume()
+{
+  cState::_OnResume();
+
+  simulation.Resume();
+}
+
 void cStateGame::SetQuitSoon()
 {
   bQuitSoon = true;
 }
 
+namespace
+{
+  struct cBindingsForBoard
+  {
+    int moveLeft;
+    int moveRight;
+    int rotateCounterClockWise;
+    int rotateClockWise;
+    int dropOneRow;
+    int dropToGround;
+  };
+
+  void AddBindingsForBoard(tetris::cInputMapper& inputMapper, tetris::DEVICE device, size_t deviceIndex, const cBindingsForBoard& buttons, size_t board)
+  {
+    inputMapper.AddBinding(device, deviceIndex, buttons.moveLeft, board, tetris::INPUT::PIECE_MOVE_LEFT);
+    inputMapper.AddBinding(device, deviceIndex, buttons.moveRight, board, tetris::INPUT::PIECE_MOVE_RIGHT);
+    inputMapper.AddBinding(device, deviceIndex, buttons.rotateCounterClockWise, board, tetris::INPUT::PIECE_ROTATE_COUNTER_CLOCKWISE);
+    inputMapper.AddBinding(device, deviceIndex, buttons.rotateClockWise, board, tetris::INPUT::PIECE_ROTATE_CLOCKWISE);
+    inputMapper.AddBinding(device, deviceIndex, buttons.dropOneRow, board, tetris::INPUT::PIECE_DROP_ONE_ROW);
+    inputMapper.AddBinding(device, deviceIndex, buttons.dropToGround, board, tetris::INPUT::PIECE_DROP_TO_GROUND);
+  }
+}
+
+void cStateGame::AddInputBindings(size_t nBoards)
+{
+  inputMapper.ClearBindings();
+
+  // Keyboard layouts, a single player gets the arrow keys, with two players the first player moves over to the left
+  const cBindingsForBoard keysArrows = {
+    static_cast<int>(breathe::gui::KEY::LEFT), static_cast<int>(breathe::gui::KEY::RIGHT),
+    static_cast<int>(breathe::gui::KEY::BACKSLASH), static_cast<int>(breathe::gui::KEY::UP),
+    static_cast<int>(breathe::gui::KEY::DOWN), static_cast<int>(breathe::gui::KEY::SPACE)
+  };
+  const cBindingsForBoard keysLetters = {
+    static_cast<int>(breathe::gui::KEY::A), static_cast<int>(breathe::gui::KEY::D),
+    static_cast<int>(breathe::gui::KEY::Q), static_cast<int>(breathe::gui::KEY::W),
+    static_cast<int>(breathe::gui::KEY::S), static_cast<int>(breathe::gui::KEY::F)
+  };
+
+  if (nBoards == 1) AddBindingsForBoard(inputMapper, tetris::DEVICE::KEYBOARD, 0, keysArrows, 0);
+  else {
+    AddBindingsForBoard(inputMapper, tetris::DEVICE::KEYBOARD, 0, keysLetters, 0);
+    AddBindingsForBoard(inputMapper, tetris::DEVICE::KEYBOARD, 0, keysArrows, 1);
+  }
+
+  // Each controller plays on the board with the same index, the dpad and the face buttons both work
+  const cBindingsForBoard buttonsDPad = {
+    static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::DPAD_LEFT), static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::DPAD_RIGHT),
+    static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::DPAD_UP), static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::B),
+    static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::DPAD_DOWN), static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::A)
+  };
+
+  for (size_t i = 0; i < nBoards; i++) {
+    AddBindingsForBoard(inputMapper, tetris::DEVICE::GAMECONTROLLER, i, buttonsDPad, i);
+    inputMapper.AddBinding(tetris::DEVICE::GAMECONTROLLER, i, static_cast<int>(breathe::util::GAMECONTROLLER_BUTTON::X), i, tetris::INPUT::PIECE_ROTATE_COUNTER_CLOCKWISE);
+  }
+}
+
 void cStateGame::UpdateText()
 {
-  for (size_t i = 0; i < game.boards.size(); i++) {
-    tetris::cBoard& board = *(game.boards[i]);
+  const tetris::cGameSnapshot& snapshot = simulation.GetSnapshot();
+
+  // Only the players' boards have text
+  const size_t n = std::min(nPlayers, snapshot.boards.size());
+  for (size_t i = 0; i < n; i++) {
+    const tetris::cBoardSnapshot& board = snapshot.boards[i];
 
     spitfire::ostringstream_t o;
 
@@ -1231,142 +1584,133 @@ void cStateGame::UpdateText()
   }
 }
 
-void cStateGame::UpdateBoardVBO(breathe::render::cVertexBufferObject& vertexBufferObject, const tetris::cBoard& board)
+void cStateGame::CreateBoardRepresentation(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board)
 {
-  //pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
-  //
-  //pBoardRepresentation->vertexBufferObjectBoardTriangles = pContext->CreateStaticVertexBufferObject();
+  // The rectangles of the atlas were added in the same order as the boards
+  blockRenderer.CreateBoardRenderTarget(boardRepresentation.renderTarget, boardRenderTargetAtlas, boardRepresentation.index, board, spitfire::math::cVec2(0.015f, 0.015f));
 
-  opengl::cGeometryDataPtr pGeometryDataPtr = opengl::CreateGeometryData();
+  if (blockRenderMode == BLOCK_RENDERER::INSTANCED) {
+    const size_t nCells = board.GetWidth() * board.GetHeight();
 
-  opengl::cGeometryBuilder_v2_c4_t2 builder(*pGeometryDataPtr);
+    // The background never changes so it is only uploaded once
+    blockRenderer.CreateInstanceBuffer(boardRepresentation.blocksBackground, nCells);
+    cBlockRenderer::BuildBackgroundInstances(board, instances);
+    blockRenderer.SetInstances(boardRepresentation.blocksBackground, instances);
 
-  const spitfire::math::cVec2 scale(0.015f, 0.015f);
-
-  const float fBlockAndLightmapU = 0.0f;
-  const float fBlockAndLightmapV = 0.0f;
-  const float fBlockAndLightmapU2 = 1.0f;
-  const float fBlockAndLightmapV2 = 1.0f;
-
-  const size_t width = board.GetWidth();
-  const size_t height = board.GetHeight();
-  for (size_t _y = 0; _y < height; _y++) {
-    for (size_t x = 0; x < width; x++) {
-      // We want to add the blocks in upside down order
-      const size_t y = (height - 1) - _y;
-
-      int c = board.GetBlock(x, _y);
-      {
-        const spitfire::math::cColour colour(board.GetColour(c));
-
-        // Front facing triangles
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV2));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV2));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV2));
-      }
-    }
+    blockRenderer.CreateInstanceBuffer(boardRepresentation.blocksBoard, nCells);
+  } else if (blockRenderMode == BLOCK_RENDERER::TEXTURE) {
+    blockRenderer.CreateBoardTexture(boardRepresentation.boardTexture, board);
+  } else {
+    blockRenderer.CreateBoardGeometryBuffer(boardRepresentation.boardGeometry, board, spitfire::math::cVec2(0.015f, 0.015f));
   }
 
-  if (pGeometryDataPtr->nVertexCount != 0) {
-    vertexBufferObject.SetData(pGeometryDataPtr);
+  if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+    blockRenderer.CreateInstanceBuffer(boardRepresentation.blocksPiece, cBlockRenderer::MAX_PIECE_BLOCKS);
+    blockRenderer.CreateInstanceBuffer(boardRepresentation.blocksNextPiece, cBlockRenderer::MAX_PIECE_BLOCKS);
+  } else {
+    blockRenderer.CreatePieceGeometryBuffer(boardRepresentation.pieceGeometry, cBlockRenderer::MAX_PIECE_BLOCKS);
+    blockRenderer.CreatePieceGeometryBuffer(boardRepresentation.nextPieceGeometry, cBlockRenderer::MAX_PIECE_BLOCKS);
+  }
 
-    vertexBufferObject.Compile2D();
+  UpdateBoard(boardRepresentation, board);
+  UpdatePiece(boardRepresentation, board);
+  UpdateNextPiece(boardRepresentation, board);
+}
+
+void cStateGame::DestroyBoardRepresentation(cBoardRepresentation& boardRepresentation)
+{
+  if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+    blockRenderer.DestroyInstanceBuffer(boardRepresentation.blocksNextPiece);
+    blockRenderer.DestroyInstanceBuffer(boardRepresentation.blocksPiece);
+  } else {
+    blockRenderer.DestroyPieceGeometryBuffer(boardRepresentation.nextPieceGeometry);
+    blockRenderer.DestroyPieceGeometryBuffer(boardRepresentation.pieceGeometry);
+  }
+
+  if (blockRenderMode == BLOCK_RENDERER::INSTANCED) {
+    blockRenderer.DestroyInstanceBuffer(boardRepresentation.blocksBoard);
+    blockRenderer.DestroyInstanceBuffer(boardRepresentation.blocksBackground);
+  } else if (blockRenderMode == BLOCK_RENDERER::TEXTURE) {
+    blockRenderer.DestroyBoardTexture(boardRepresentation.boardTexture);
+  } else {
+    blockRenderer.DestroyBoardGeometryBuffer(boardRepresentation.boardGeometry);
   }
+
+  blockRenderer.DestroyBoardRenderTarget(boardRepresentation.renderTarget);
 }
 
-void cStateGame::UpdatePieceVBO(breathe::render::cVertexBufferObject& vertexBufferObject, const tetris::cBoard& board, const tetris::cPiece& piece)
+void cStateGame::UpdateBoard(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board)
 {
-  std::cout<<"cStateGame::UpdatePieceVBO"<<std::endl;
+  boardRepresentation.bIsRenderTargetDirty = true;
 
-  //pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
-  //
-  //pBoardRepresentation->vertexBufferObjectBoardTriangles = pContext->CreateStaticVertexBufferObject();
+  if (blockRenderMode == BLOCK_RENDERER::INSTANCED) {
+    cBlockRenderer::BuildBoardInstances(board, instances);
+    blockRenderer.SetInstances(boardRepresentation.blocksBoard, instances);
+  } else if (blockRenderMode == BLOCK_RENDERER::TEXTURE) {
+    // Only the rows that have changed since the last update are uploaded
+    blockRenderer.UpdateBoardTexture(boardRepresentation.boardTexture, board);
+  } else {
+    // Only the rows that have changed since the last update are rebuilt
+    blockRenderer.UpdateBoardGeometry(boardRepresentation.boardGeometry, board, spitfire::math::cVec2(0.015f, 0.015f));
+  }
+}
 
-  opengl::cGeometryDataPtr pGeometryDataPtr = opengl::CreateGeometryData();
+void cStateGame::UpdatePiece(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board)
+{
+  if (boardRepresentation.detail == BOARD_DETAIL::LOW) boardRepresentation.bIsRenderTargetDirty = true;
 
-  opengl::cGeometryBuilder_v2_c4_t2 builder(*pGeometryDataPtr);
+  boardRepresentation.pieceMesh = pieceMeshCache.Find(board.GetCurrentPiece());
+  if (boardRepresentation.pieceMesh.IsValid()) return;
 
-  const spitfire::math::cVec2 scale(0.015f, 0.015f);
-
-  const float fBlockAndLightmapU = 0.0f;
-  const float fBlockAndLightmapV = 0.0f;
-  const float fBlockAndLightmapU2 = 1.0f;
-  const float fBlockAndLightmapV2 = 1.0f;
-
-  const size_t width = piece.GetWidth();
-  const size_t height = piece.GetHeight();
-  for (size_t _y = 0; _y < height; _y++) {
-    for (size_t x = 0; x < width; x++) {
-      // We want to add the blocks in upside down order
-      const size_t y = (height - 1) - _y;
-
-      int c = piece.GetBlock(x, _y);
-      if (c != 0) {
-        const spitfire::math::cColour colour(board.GetColour(c));
-
-        // Front facing quad
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV2));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV2));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x + 1), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU2, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV));
-        builder.PushBack(scale * spitfire::math::cVec2(float(x), float(y + 1)), colour, spitfire::math::cVec2(fBlockAndLightmapU, fBlockAndLightmapV2));
-      }
-    }
+  if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+    cBlockRenderer::BuildPieceInstances(board.GetCurrentPiece(), instances);
+    blockRenderer.SetInstances(boardRepresentation.blocksPiece, instances);
+  } else {
+    blockRenderer.UpdatePieceGeometry(boardRepresentation.pieceGeometry, board, board.GetCurrentPiece(), spitfire::math::cVec2(0.015f, 0.015f));
   }
+}
 
-  if (pGeometryDataPtr->nVertexCount != 0) {
-    vertexBufferObject.SetData(pGeometryDataPtr);
+void cStateGame::UpdateNextPiece(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board)
+{
+  boardRepresentation.nextPieceMesh = pieceMeshCache.Find(board.GetNextPiece());
+  if (boardRepresentation.nextPieceMesh.IsValid()) return;
 
-    vertexBufferObject.Compile2D();
+  if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+    cBlockRenderer::BuildPieceInstances(board.GetNextPiece(), instances);
+    blockRenderer.SetInstances(boardRepresentation.blocksNextPiece, instances);
+  } else {
+    blockRenderer.UpdatePieceGeometry(boardRepresentation.nextPieceGeometry, board, board.GetNextPiece(), spitfire::math::cVec2(0.015f, 0.015f));
   }
 }
 
-void cStateGame::_OnPieceMoved(const tetris::cBoard& board)
+void cStateGame::_OnPieceMoved(const tetris::cBoardSnapshot& board)
 {
-  std::cout<<"cStateGame::_OnPieceMoved"<<std::endl;
-  //... update piece position
+  // Sent for every gravity drop and repeated move on every board so it isn't logged.  The piece is drawn from the latest
+  // snapshot, the event only has to make the frame dirty which _Update does for every event
 }
 
-void cStateGame::_OnPieceRotated(const tetris::cBoard& board)
+void cStateGame::_OnPieceRotated(const tetris::cBoardSnapshot& board)
 {
   std::cout<<"cStateGame::_OnPieceRotated"<<std::endl;
 
-  const size_t n = boardRepresentations.size();
-  for (size_t i = 0; i < n; i++) {
-    if (&boardRepresentations[i]->board == &board) {
-      pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
+  assert(board.GetIndex() < boardRepresentations.size());
+  cBoardRepresentation* pBoardRepresentation = boardRepresentations[board.GetIndex()];
 
-      pContext->CreateStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
-      UpdatePieceVBO(boardRepresentations[i]->vertexBufferObjectPieceTriangles, board, board.GetCurrentPiece());
-    }
-  }
+  UpdatePiece(*pBoardRepresentation, board);
 }
 
-void cStateGame::_OnPieceChanged(const tetris::cBoard& board)
+void cStateGame::_OnPieceChanged(const tetris::cBoardSnapshot& board)
 {
   std::cout<<"cStateGame::_OnPieceChanged"<<std::endl;
 
-  const size_t n = boardRepresentations.size();
-  for (size_t i = 0; i < n; i++) {
-    if (&boardRepresentations[i]->board == &board) {
-      pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
-
-      pContext->CreateStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectPieceTriangles);
-      UpdatePieceVBO(boardRepresentations[i]->vertexBufferObjectPieceTriangles, board, board.GetCurrentPiece());
+  assert(board.GetIndex() < boardRepresentations.size());
+  cBoardRepresentation* pBoardRepresentation = boardRepresentations[board.GetIndex()];
 
-      pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectNextPieceTriangles);
-
-      pContext->CreateStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectNextPieceTriangles);
-      UpdatePieceVBO(boardRepresentations[i]->vertexBufferObjectNextPieceTriangles, board, board.GetNextPiece());
-    }
-  }
+  UpdatePiece(*pBoardRepresentation, board);
+  UpdateNextPiece(*pBoardRepresentation, board);
 }
 
-void cStateGame::_OnPieceHitsGround(const tetris::cBoard& board)
+void cStateGame::_OnPieceHitsGround(const tetris::cBoardSnapshot& board)
 {
   std::cout<<"cStateGame::_OnPieceHitsGround"<<std::endl;
   application.PlaySound(pAudioBufferPieceHitsGround);
@@ -1374,49 +1718,55 @@ void cStateGame::_OnPieceHitsGround(const tetris::cBoard& board)
   // Shake the gui
   spring.SetPosition(spitfire::math::cVec2(0.0f, -0.02f));
   spring.SetVelocity(spitfire::math::cVec2(0.0f, -0.00001f));
+
+  animations.Add(ANIMATION::LOCK, board.GetIndex(), 0, std::chrono::steady_clock::now());
 }
 
-void cStateGame::_OnBoardChanged(const tetris::cBoard& board)
+void cStateGame::_OnBoardChanged(const tetris::cBoardSnapshot& board)
 {
   std::cout<<"cStateGame::_OnBoardChanged"<<std::endl;
 
-  const size_t n = boardRepresentations.size();
-  for (size_t i = 0; i < n; i++) {
-    if (&boardRepresentations[i]->board == &board) {
-      pContext->DestroyStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectBoardTriangles);
-      pContext->CreateStaticVertexBufferObject(boardRepresentations[i]->vertexBufferObjectBoardTriangles);
-      UpdateBoardVBO(boardRepresentations[i]->vertexBufferObjectBoardTriangles, board);
-    }
-  }
+  assert(board.GetIndex() < boardRepresentations.size());
+  cBoardRepresentation* pBoardRepresentation = boardRepresentations[board.GetIndex()];
+
+  UpdateBoard(*pBoardRepresentation, board);
 }
 
-void cStateGame::_OnGameScoreTetris(const tetris::cBoard& board, size_t uiScore)
+void cStateGame::_OnGameScoreTetris(const tetris::cBoardSnapshot& board, size_t uiScore)
 {
   std::cout<<"cStateGame::_OnGameScoreTetris"<<std::endl;
   application.PlaySound(pAudioBufferScoreTetris);
   UpdateText();
 
+  EmitLineParticles(board, PARTICLES_PER_BLOCK_TETRIS, spitfire::math::cColour(1.0f, 0.85f, 0.2f));
+
   // Shake the gui
   spring.SetPosition(spitfire::math::cVec2(0.0f, -0.05f));
   spring.SetVelocity(spitfire::math::cVec2(0.0f, -0.00001f));
 }
 
-void cStateGame::_OnGameScoreOtherThanTetris(const tetris::cBoard& board, size_t uiScore)
+void cStateGame::_OnGameScoreOtherThanTetris(const tetris::cBoardSnapshot& board, size_t uiScore)
 {
   std::cout<<"cStateGame::_OnGameScoreOtherThanTetris"<<std::endl;
   application.PlaySound(pAudioBufferScoreOtherThanTetris);
   UpdateText();
+
+  EmitLineParticles(board, PARTICLES_PER_BLOCK, spitfire::math::cColour(1.0f, 1.0f, 1.0f));
 }
 
-void cStateGame::_OnGameNewLevel(const tetris::cBoard& board, size_t uiLevel)
+void cStateGame::_OnGameNewLevel(const tetris::cBoardSnapshot& board, size_t uiLevel)
 {
   std::cout<<"cStateGame::_OnGameNewLevel"<<std::endl;
   //... show new level message
 }
 
-void cStateGame::_OnGameOver(const tetris::cBoard& board)
+void cStateGame::_OnGameOver(const tetris::cBoardSnapshot& board)
 {
   std::cout<<"cStateGame::_OnGameOver"<<std::endl;
+
+  // Nobody plays the spectator boards so they top out all the time, they don't get a sound or a high score
+  if (board.GetIndex() >= nPlayers) return;
+
   application.PlaySound(pAudioBufferGameOver);
   //... show game over screen, stop game
 
@@ -1424,16 +1774,52 @@ void cStateGame::_OnGameOver(const tetris::cBoard& board)
   table.Load();
 
   if (table.IsScoreGoodEnough(board.GetScore())) {
-    const size_t n = boardRepresentations.size();
-    for (size_t i = 0; i < n; i++) {
-      if (&boardRepresentations[i]->board == &board) {
-        table.SubmitEntry(boardRepresentations[i]->sName, board.GetScore());
-        table.Save();
-      }
+    assert(board.GetIndex() < boardRepresentations.size());
+    table.SubmitEntry(boardRepresentations[board.GetIndex()]->sName, board.GetScore());
+    table.Save();
+  }
+}
+
+void cStateGame::_OnLineCleared(const tetris::cBoardSnapshot& board, size_t row)
+{
+  animations.Add(ANIMATION::LINE_CLEAR, board.GetIndex(), row, std::chrono::steady_clock::now());
+
+  // The score event comes straight after the lines so it can send the particles flying out of them
+  clearedRows.push_back(std::make_pair(board.GetIndex(), row));
+}
+
+void cStateGame::EmitLineParticles(const tetris::cBoardSnapshot& board, size_t nParticlesPerBlock, const spitfire::math::cColour& colour)
+{
+  assert(board.GetIndex() < boardRepresentations.size());
+  const cBoardRepresentation& boardRepresentation = *boardRepresentations[board.GetIndex()];
+
+  // Particles that are already flying were moved up to the last frame, new ones start from now
+  if (particles.IsEmpty()) particlesUpdated = std::chrono::steady_clock::now();
+
+  const float fBlockSize = 0.015f * boardRepresentation.fScale;
+  const spitfire::math::cVec2 area(fBlockSize * float(board.GetWidth()), fBlockSize);
+
+  size_t i = 0;
+  while (i < clearedRows.size()) {
+    if (clearedRows[i].first != board.GetIndex()) {
+      i++;
+      continue;
     }
+
+    // Rows count up from the bottom of the board
+    const size_t row = clearedRows[i].second;
+    const spitfire::math::cVec2 position(boardRepresentation.position.x, boardRepresentation.position.y + (fBlockSize * (float(board.GetHeight()) - 1.0f - float(row))));
+    particles.Emit(position, area, colour, nParticlesPerBlock * board.GetWidth(), 0.4f * boardRepresentation.fScale, 0.4f * fBlockSize);
+
+    clearedRows.erase(clearedRows.begin() + i);
   }
 }
 
+void cStateGame::_OnLinesAdded(const tetris::cBoardSnapshot& board, size_t lines)
+{
+  animations.Add(ANIMATION::GARBAGE_RISE, board.GetIndex(), lines, std::chrono::steady_clock::now());
+}
+
 void cStateGame::_OnStateKeyboardEvent(const breathe::gui::cKeyboardEvent& event)
 {
   std::cout<<"cStateGame::_OnStateKeyboardEvent"<<std::endl;
@@ -1454,94 +1840,38 @@ void cStateGame::_OnStateKeyboardEvent(const breathe::gui::cKeyboardEvent& event
         bIsWireframe = !bIsWireframe;
         break;
       }
+      case breathe::gui::KEY::NUMBER_2: {
+        std::cout<<"cStateGame::_OnStateKeyboardEvent 2 up"<<std::endl;
+        bIsProfiling = !bIsProfiling;
+        UpdateProfilingText();
+        break;
+      }
     }
   }
+
+  // Everything else is sent to the boards with the time of the event
+  const tetris::timepoint_t now = std::chrono::steady_clock::now();
+  const int key = static_cast<int>(event.GetKeyCode());
+  if (event.IsKeyDown()) inputMapper.OnButtonDown(tetris::DEVICE::KEYBOARD, 0, key, now);
+  else if (event.IsKeyUp()) inputMapper.OnButtonUp(tetris::DEVICE::KEYBOARD, 0, key, now);
 }
 
   void cStateGame::_OnStateJoystickEvent(const breathe::util::cJoystickEvent& event)
   {
-    const size_t index = event.GetIndex();
-    const size_t n = boardRepresentations.size();
-    if (index > n) return;
-
-    // Convert the joystick button up events to keyboard events
-    if (event.IsButtonUp()) {
-      cBoardRepresentation* pBoardRepresentation = boardRepresentations[index];
-
-      switch (event.GetButton()) {
-        case breathe::util::GAMECONTROLLER_BUTTON::DPAD_LEFT: {
-          pBoardRepresentation->bIsInputPieceMoveLeft = true;
-          break;
-        }
-        case breathe::util::GAMECONTROLLER_BUTTON::DPAD_RIGHT: {
-          pBoardRepresentation->bIsInputPieceMoveRight = true;
-          break;
-        }
-        case breathe::util::GAMECONTROLLER_BUTTON::DPAD_UP: {
-          pBoardRepresentation->bIsInputPieceRotateCounterClockWise = true;
-          break;
-        }
-        case breathe::util::GAMECONTROLLER_BUTTON::DPAD_DOWN: {
-          pBoardRepresentation->bIsInputPieceDropOneRow = true;
-          break;
-        }
-
-        case breathe::util::GAMECONTROLLER_BUTTON::X: {
-          pBoardRepresentation->bIsInputPieceRotateCounterClockWise = true;
-          break;
-        }
-        case breathe::util::GAMECONTROLLER_BUTTON::B: {
-          pBoardRepresentation->bIsInputPieceRotateClockWise = true;
-          break;
-        }
-
-        case breathe::util::GAMECONTROLLER_BUTTON::A: {
-          pBoardRepresentation->bIsInputPieceDropToGround = true;
-          break;
-        }
-
-        case breathe::util::GAMECONTROLLER_BUTTON::START: {
-          bPauseSoon = true;
-          break;
-        }
-      }
+    if (event.IsButtonUp() && (event.GetButton() == breathe::util::GAMECONTROLLER_BUTTON::START)) {
+      bPauseSoon = true;
+      return;
     }
+
+    // Everything else is sent to the boards with the time of the event
+    const tetris::timepoint_t now = std::chrono::steady_clock::now();
+    const int button = static_cast<int>(event.GetButton());
+    if (event.IsButtonDown()) inputMapper.OnButtonDown(tetris::DEVICE::GAMECONTROLLER, event.GetIndex(), button, now);
+    else if (event.IsButtonUp()) inputMapper.OnButtonUp(tetris::DEVICE::GAMECONTROLLER, event.GetIndex(), button, now);
   }
 
 void cStateGame::_Update(const spitfire::math::cTimeStep& timeStep)
 {
-  // For each board we need to send the inputs to the board
-  const size_t n = boardRepresentations.size();
-  for (size_t i = 0; i < n; i++) {
-    cBoardRepresentation* pBoardRepresentation = boardRepresentations[i];
-    tetris::cBoard& board = pBoardRepresentation->board;
-
-    if (pBoardRepresentation->bIsInputPieceRotateCounterClockWise) {
-      board.PieceRotateCounterClockWise();
-      pBoardRepresentation->bIsInputPieceRotateCounterClockWise = false;
-    }
-    if (pBoardRepresentation->bIsInputPieceRotateClockWise) {
-      board.PieceRotateClockWise();
-      pBoardRepresentation->bIsInputPieceRotateClockWise = false;
-    }
-    if (pBoardRepresentation->bIsInputPieceDropOneRow) {
-      board.PieceDropOneRow(timeStep.GetCurrentTimeMS());
-      pBoardRepresentation->bIsInputPieceDropOneRow = false;
-    }
-    if (pBoardRepresentation->bIsInputPieceDropToGround) {
-      board.PieceDropToGround(timeStep.GetCurrentTimeMS());
-      pBoardRepresentation->bIsInputPieceDropToGround = false;
-    }
-    if (pBoardRepresentation->bIsInputPieceMoveLeft) {
-      board.PieceMoveLeft();
-      pBoardRepresentation->bIsInputPieceMoveLeft = false;
-    }
-    if (pBoardRepresentation->bIsInputPieceMoveRight) {
-      board.PieceMoveRight();
-      pBoardRepresentation->bIsInputPieceMoveRight = false;
-    }
-  }
-
   if (bPauseSoon) {
     // Push our game state
     application.PushStateSoon(new cStatePauseMenu(application, *this));
@@ -1550,217 +1880,341 @@ void cStateGame::_Update(const spitfire::math::cTimeStep& timeStep)
   if (bQuitSoon) {
     // Pop our menu state
     application.PopStateSoon();
+
+    // The boards may never have been created so there is nothing left to present
+    return;
   }
 
-  game.Update(timeStep.GetCurrentTimeMS());
+  // The game is updated on the simulation thread, we just present everything that has happened since the last frame
+  if (simulation.DispatchEvents(*this)) SetDirty();
 
-  // Update the hud offset to shake the gui
-  spring.Update(timeStep);
+  UpdateGui(timeStep);
+}
 
-  pGuiManager->SetHUDOffset(spring.GetPosition());
+spitfire::durationms_t cStateGame::_GetMaximumIdleWait() const
+{
+  // Events from the simulation don't wake the main loop so while anyone is playing we check for them every tick
+  const tetris::cGameSnapshot& snapshot = simulation.GetSnapshot();
+  const size_t n = snapshot.boards.size();
+  for (size_t i = 0; i < n; i++) {
+    if (snapshot.boards[i].IsPlaying()) return tetris::SIMULATION_TICK_MS;
+  }
 
-  pGuiRenderer->Update();
+  return cState::_GetMaximumIdleWait();
 }
 
-void cStateGame::_UpdateInput(const spitfire::math::cTimeStep& timeStep)
+void cStateGame::QueuePiece(const cPieceMeshRange& range, const cPieceGeometryBuffer& geometry, const cBlockInstanceBuffer& blocks, const spitfire::math::cVec2& position)
 {
-  assert(pWindow != nullptr);
+  if (range.IsValid()) renderQueue.AddPieceMesh(pieceMeshCache, range, position);
+  else if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) renderQueue.AddInstances(BLOCK_LAYER::BLOCKS, blocks, position);
+  else renderQueue.AddPieceGeometry(geometry, position);
+}
 
-  if (boardRepresentations.size() == 1) {
-    // Single player
-    cBoardRepresentation* pBoardRepresentation = boardRepresentations[0];
+void cStateGame::RenderBoardToTarget(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board)
+{
+  const spitfire::math::cVec2 position(0.0f, 0.0f);
 
-    // Player 1
-    if (pWindow->IsKeyUp(breathe::gui::KEY::BACKSLASH)) {
-      //std::cout<<"cStateGame::UpdateInput BACKSLASH up"<<std::endl;
-      pBoardRepresentation->bIsInputPieceRotateCounterClockWise = true;
-    }
-    if (pWindow->IsKeyUp(breathe::gui::KEY::UP)) {
-      //std::cout<<"cStateGame::UpdateInput UP up"<<std::endl;
-      pBoardRepresentation->bIsInputPieceRotateClockWise = true;
-    }
-    if (pWindow->IsKeyHeld(breathe::gui::KEY::DOWN)) {
-      //std::cout<<"cStateGame::UpdateInput DOWN held"<<std::endl;
-      pBoardRepresentation->bIsInputPieceDropOneRow = true;
-    }
-    if (pWindow->IsKeyUp(breathe::gui::KEY::SPACE)) {
-      //std::cout<<"cStateGame::UpdateInput SPACE up"<<std::endl;
-      pBoardRepresentation->bIsInputPieceDropToGround = true;
-    }
-    if (pWindow->IsKeyHeld(breathe::gui::KEY::LEFT)) {
-      //std::cout<<"cStateGame::UpdateInput LEFT Held"<<std::endl;
-      if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyLeft) > 50) {
-        pBoardRepresentation->bIsInputPieceMoveLeft = true;
-        pBoardRepresentation->lastKeyLeft = timeStep.GetCurrentTimeMS();
-      }
+  breathe::render::cShader* pShader = pShaderBlock;
+  if (blockRenderMode == BLOCK_RENDERER::INSTANCED) {
+    pShader = pShaderBlockInstanced;
+    renderQueue.AddInstances(BLOCK_LAYER::BACKGROUND, boardRepresentation.blocksBackground, position);
+    renderQueue.AddInstances(BLOCK_LAYER::BLOCKS, boardRepresentation.blocksBoard, position);
+  } else if (blockRenderMode == BLOCK_RENDERER::TEXTURE) {
+    pShader = pShaderBoardTexture;
+    renderQueue.AddBoardTexture(boardRepresentation.boardTexture, position);
+  } else renderQueue.AddBoardGeometry(boardRepresentation.boardGeometry, position);
+
+  blockRenderer.BeginBoardRenderTarget(boardRepresentation.renderTarget);
+
+  pContext->BindTexture(0, *pTextureBlock);
+
+  pContext->BindShader(*pShader);
+
+  blockRenderer.SetBoardRenderTargetProjection(boardRepresentation.renderTarget);
+
+  if (blockRenderMode != BLOCK_RENDERER::GEOMETRY) {
+    blockRenderer.SetBlockSize(spitfire::math::cVec2(0.015f, 0.015f));
+    blockRenderer.SetColours(board);
+  }
+
+  blockRenderer.Submit(renderQueue);
+
+  pContext->UnBindShader(*pShader);
+
+  // Low detail boards don't draw their pieces separately
+  boardRepresentation.bIsPieceInRenderTarget = false;
+  if ((boardRepresentation.detail == BOARD_DETAIL::LOW) && board.IsPlaying()) {
+    boardRepresentation.bIsPieceInRenderTarget = true;
+    boardRepresentation.pieceXInRenderTarget = board.GetCurrentPieceX();
+    boardRepresentation.pieceYInRenderTarget = board.GetCurrentPieceY();
+
+    const spitfire::math::cVec2 positionPiece(0.015f * float(board.GetCurrentPieceX()), 0.015f * (float(board.GetHeight()) - float(board.GetCurrentPieceY())));
+    QueuePiece(boardRepresentation.pieceMesh, boardRepresentation.pieceGeometry, boardRepresentation.blocksPiece, positionPiece);
+
+    breathe::render::cShader* pShaderPiece = (pieceRenderMode == BLOCK_RENDERER::INSTANCED) ? pShaderBlockInstanced : pShaderBlock;
+
+    pContext->BindShader(*pShaderPiece);
+
+    blockRenderer.SetBoardRenderTargetProjection(boardRepresentation.renderTarget);
+
+    if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+      blockRenderer.SetBlockSize(spitfire::math::cVec2(0.015f, 0.015f));
+      blockRenderer.SetColours(board);
     }
-    if (pWindow->IsKeyHeld(breathe::gui::KEY::RIGHT)) {
-      //std::cout<<"cStateGame::UpdateInput RIGHT Held"<<std::endl;
-      if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyRight) > 50) {
-        pBoardRepresentation->bIsInputPieceMoveRight = true;
-        pBoardRepresentation->lastKeyRight = timeStep.GetCurrentTimeMS();
+
+    blockRenderer.Submit(renderQueue);
+
+    pContext->UnBindShader(*pShaderPiece);
+  }
+
+  pContext->UnBindTexture(0, *pTextureBlock);
+
+  blockRenderer.EndBoardRenderTarget(boardRepresentation.renderTarget);
+
+  boardRepresentation.bIsRenderTargetDirty = false;
+}
+
+void cStateGame::RenderBoards(const tetris::cGameSnapshot& snapshot)
+{
+  nFrame++;
+
+  const tetris::timepoint_t now = std::chrono::steady_clock::now();
+
+  // Keep drawing frames until every effect has finished
+  animations.Update(now);
+  if (!animations.IsEmpty()) SetDirty();
+
+  const size_t n = boardRepresentations.size();
+
+  // The boards only change when a piece lands, a line is cleared or a line is added, so most frames nothing is redrawn here
+  for (size_t i = 0; i < n; i++) {
+    cBoardRepresentation* pBoardRepresentation = boardRepresentations[i];
+    const tetris::cBoardSnapshot& board = snapshot.boards[pBoardRepresentation->index];
+
+    if (pBoardRepresentation->detail == BOARD_DETAIL::FULL) {
+      if (pBoardRepresentation->bIsRenderTargetDirty) RenderBoardToTarget(*pBoardRepresentation, board);
+    } else {
+      // The current piece is part of a low detail board so it has changed if the piece has moved too
+      const bool bIsPieceMoved = (
+        (pBoardRepresentation->bIsPieceInRenderTarget != board.IsPlaying()) ||
+        (board.IsPlaying() && ((pBoardRepresentation->pieceXInRenderTarget != board.GetCurrentPieceX()) || (pBoardRepresentation->pieceYInRenderTarget != board.GetCurrentPieceY())))
+      );
+      if (pBoardRepresentation->bIsRenderTargetDirty || bIsPieceMoved) {
+        if (((nFrame + i) % LOW_DETAIL_UPDATE_FRAMES) == 0) RenderBoardToTarget(*pBoardRepresentation, board);
+        else SetDirty(); // Keep drawing frames until it is this board's turn
       }
     }
-  } else {
-    {
-      // Player 1
-      cBoardRepresentation* pBoardRepresentation = boardRepresentations[0];
+  }
 
-      if (pWindow->IsKeyUp(breathe::gui::KEY::Q)) {
-        //std::cout<<"cStateGame::UpdateInput Q up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceRotateCounterClockWise = true;
-      }
-      if (pWindow->IsKeyUp(breathe::gui::KEY::W)) {
-        //std::cout<<"cStateGame::UpdateInput W up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceRotateClockWise = true;
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::S)) {
-        //std::cout<<"cStateGame::UpdateInput S Held"<<std::endl;
-        pBoardRepresentation->bIsInputPieceDropOneRow = true;
-      }
-      if (pWindow->IsKeyUp(breathe::gui::KEY::F)) {
-        //std::cout<<"cStateGame::UpdateInput F up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceDropToGround = true;
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::A)) {
-        //std::cout<<"cStateGame::UpdateInput A Held"<<std::endl;
-        if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyLeft) > 50) {
-          pBoardRepresentation->bIsInputPieceMoveLeft = true;
-          pBoardRepresentation->lastKeyLeft = timeStep.GetCurrentTimeMS();
-        }
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::D)) {
-        //std::cout<<"cStateGame::UpdateInput D Held"<<std::endl;
-        if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyRight) > 50) {
-          pBoardRepresentation->bIsInputPieceMoveRight = true;
-          pBoardRepresentation->lastKeyRight = timeStep.GetCurrentTimeMS();
-        }
+  // How far the simulation has got past the snapshot, worked out from when the snapshot's tick was due rather than from
+  // when we first saw it so that it doesn't depend on where in the frame the snapshot arrived.  It is never more than a
+  // tick so that the pieces stop when the simulation is paused or stalls.
+  const float fSinceTickMS = std::chrono::duration<float, std::milli>(now - snapshot.tickTime).count();
+  const float fAheadMS = std::max(0.0f, std::min(fSinceTickMS, float(tetris::SIMULATION_TICK_MS)));
+
+  // Gather the draws for every board first, the queue sorts them so that all the boards share one set of state changes
+  for (size_t i = 0; i < n; i++) {
+    cBoardRepresentation* pBoardRepresentation = boardRepresentations[i];
+    const tetris::cBoardSnapshot& board = snapshot.boards[pBoardRepresentation->index];
+
+    // Garbage rising and pieces landing move the whole board, the cached board is just drawn a little lower
+    const float fOffsetY = 0.015f * pBoardRepresentation->fScale * animations.GetBoardOffsetBlocks(pBoardRepresentation->index, now);
+
+    const float x = pBoardRepresentation->position.x;
+    const float y = pBoardRepresentation->position.y + fOffsetY;
+
+    renderQueueBoards.AddBoardRenderTarget(pBoardRepresentation->renderTarget, spitfire::math::cVec2(x, y), pBoardRepresentation->fScale);
+
+    if (pBoardRepresentation->detail != BOARD_DETAIL::FULL) continue;
+
+    if (board.IsPlaying()) {
+      // The piece slides down towards the next row over the whole drop interval and arrives as gravity moves it there, so
+      // it falls smoothly at any refresh rate.  Moving sideways, dropping to the ground and a new piece still snap straight
+      // to the new position.
+      float fFall = 0.0f;
+      if (board.CanPieceDrop()) {
+        const float fSinceDropMS = float(snapshot.currentTime - board.GetLastDropTime()) + fAheadMS;
+        fFall = std::max(0.0f, std::min(fSinceDropMS / float(board.GetDropInterval()), 1.0f));
+
+        // Keep drawing while the piece is falling
+        SetDirty();
       }
+
+      const float fPieceX = float(board.GetCurrentPieceX());
+      const float fPieceY = float(board.GetCurrentPieceY()) - fFall;
+
+      const spitfire::math::cVec2 positionPiece(x + (0.015f * fPieceX), y + (0.015f * (float(board.GetHeight()) - fPieceY)));
+      QueuePiece(pBoardRepresentation->pieceMesh, pBoardRepresentation->pieceGeometry, pBoardRepresentation->blocksPiece, positionPiece);
     }
 
-    {
-      // Player 2
-      cBoardRepresentation* pBoardRepresentation = boardRepresentations[1];
+    const spitfire::math::cVec2 positionNextPiece(x + (0.015f * float(board.GetWidth())) + (0.015f * 3.0f), y + (0.015f * (0.5f * float(board.GetHeight()))));
+    QueuePiece(pBoardRepresentation->nextPieceMesh, pBoardRepresentation->nextPieceGeometry, pBoardRepresentation->blocksNextPiece, positionNextPiece);
+  }
 
-      if (pWindow->IsKeyUp(breathe::gui::KEY::BACKSLASH)) {
-        //std::cout<<"cStateGame::UpdateInput BACKSLASH up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceRotateCounterClockWise = true;
-      }
-      if (pWindow->IsKeyUp(breathe::gui::KEY::UP)) {
-        //std::cout<<"cStateGame::UpdateInput UP up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceRotateClockWise = true;
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::DOWN)) {
-        //std::cout<<"cStateGame::UpdateInput DOWN Held"<<std::endl;
-        pBoardRepresentation->bIsInputPieceDropOneRow = true;
-      }
-      if (pWindow->IsKeyUp(breathe::gui::KEY::SPACE)) {
-        //std::cout<<"cStateGame::UpdateInput SPACE up"<<std::endl;
-        pBoardRepresentation->bIsInputPieceDropToGround = true;
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::LEFT)) {
-        //std::cout<<"cStateGame::UpdateInput LEFT Held"<<std::endl;
-        if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyLeft) > 50) {
-          pBoardRepresentation->bIsInputPieceMoveLeft = true;
-          pBoardRepresentation->lastKeyLeft = timeStep.GetCurrentTimeMS();
-        }
-      }
-      if (pWindow->IsKeyHeld(breathe::gui::KEY::RIGHT)) {
-        //std::cout<<"cStateGame::UpdateInput RIGHT Held"<<std::endl;
-        if ((timeStep.GetCurrentTimeMS() - pBoardRepresentation->lastKeyRight) > 50) {
-          pBoardRepresentation->bIsInputPieceMoveRight = true;
-          pBoardRepresentation->lastKeyRight = timeStep.GetCurrentTimeMS();
-        }
-      }
+  // Each draw has its own offset so the model view matrix is the same for all of them
+  spitfire::math::cMat4 matModelView2D;
+
+  // The boards go underneath the pieces, each one is a single quad with its render target as the texture
+  {
+    pContext->BindShader(*pShaderBlock);
+
+    pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
+
+    blockRenderer.Submit(renderQueueBoards);
+
+    pContext->UnBindShader(*pShaderBlock);
+  }
+
+  if (!renderQueue.IsEmpty()) {
+    pContext->BindTexture(0, *pTextureBlock);
+
+    breathe::render::cShader* pShader = (pieceRenderMode == BLOCK_RENDERER::INSTANCED) ? pShaderBlockInstanced : pShaderBlock;
+
+    pContext->BindShader(*pShader);
+
+    pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
+
+    if (pieceRenderMode == BLOCK_RENDERER::INSTANCED) {
+      // Every board has the same colours
+      blockRenderer.SetBlockSize(spitfire::math::cVec2(0.015f, 0.015f));
+      blockRenderer.SetColours(snapshot.boards[0]);
     }
+
+    blockRenderer.Submit(renderQueue);
+
+    pContext->UnBindShader(*pShader);
+
+    pContext->UnBindTexture(0, *pTextureBlock);
   }
+
+  RenderEffects(now);
+
+  RenderParticles(now);
 }
 
-void cStateGame::_RenderToTexture(const spitfire::math::cTimeStep& timeStep)
+void cStateGame::RenderParticles(tetris::timepoint_t now)
 {
-  // Render the scene
-  const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
-  pContext->SetClearColour(clearColour);
+  // A long gap between frames is only one short step so that particles don't jump across the screen
+  const float fTimeStepSeconds = std::min(std::chrono::duration<float>(now - particlesUpdated).count(), 0.1f);
+  particlesUpdated = now;
 
-  if (bIsWireframe) pContext->EnableWireframe();
+  if (particles.IsEmpty()) return;
 
-  {
-    pContext->BeginRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO);
+  particles.Update(fTimeStepSeconds);
+  if (bIsProfiling) UpdateProfilingText();
 
-    // Draw the boards
-    {
-      assert(!game.boards.empty());
+  // Keep drawing frames until every particle has gone
+  SetDirty();
 
-      float x = 0.5f;
-      const float y = 0.1f;
+  spitfire::math::cMat4 matModelView2D;
 
-      const size_t n = boardRepresentations.size();
-      for (size_t i = 0; i < n; i++) {
-        cBoardRepresentation* pBoardRepresentation = boardRepresentations[i];
-        //const tetris::cBoard& board = pBoardRepresentation->board;
+  pContext->EnableBlending();
 
-        breathe::render::cVertexBufferObject& vertexBufferObjectBoardTriangles = pBoardRepresentation->vertexBufferObjectBoardTriangles;
-        if (vertexBufferObjectBoardTriangles.IsCompiled()) {
-          spitfire::math::cMat4 matModelView2D;
-          matModelView2D.SetTranslation(x, y, 0.0f);
+  pContext->BindTexture(0, *pTextureBlock);
 
-          pContext->BindTexture(0, *pTextureBlock);
+  pContext->BindShader(*pShaderParticle);
 
-          pContext->BindShader(*pShaderBlock);
+  pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
 
-          pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
+  particles.Render();
 
-          pContext->BindStaticVertexBufferObject2D(vertexBufferObjectBoardTriangles);
-          pContext->DrawStaticVertexBufferObjectTriangles2D(vertexBufferObjectBoardTriangles);
-          pContext->UnBindStaticVertexBufferObject2D(vertexBufferObjectBoardTriangles);
+  pContext->UnBindShader(*pShaderParticle);
 
-          pContext->UnBindShader(*pShaderBlock);
+  pContext->UnBindTexture(0, *pTextureBlock);
 
-          pContext->UnBindTexture(0, *pTextureBlock);
-        }
+  pContext->DisableBlending();
+}
 
-        breathe::render::cVertexBufferObject& vertexBufferObjectPieceTriangles = pBoardRepresentation->vertexBufferObjectPieceTriangles;
-        if (pBoardRepresentation->board.IsPlaying() && vertexBufferObjectPieceTriangles.IsCompiled()) {
-          spitfire::math::cMat4 matModelView2D;
-          matModelView2D.SetTranslation(x + (0.015f * float(pBoardRepresentation->board.GetCurrentPieceX())), y + (0.015f * (float(pBoardRepresentation->board.GetHeight()) - float(pBoardRepresentation->board.GetCurrentPieceY()))), 0.0f);
+void cStateGame::UpdateProfilingText()
+{
+  if (!bIsProfiling) {
+    pProfilingText->SetCaption(TEXT(""));
+    return;
+  }
 
-          pContext->BindTexture(0, *pTextureBlock);
+  spitfire::ostringstream_t o;
+  o<<TEXT("Particles ");
+  o<<particles.GetCount();
+  o<<TEXT(" update ");
+  o<<particles.GetUpdateDurationMS();
+  o<<TEXT(" ms");
+  pProfilingText->SetCaption(o.str());
+}
 
-          pContext->BindShader(*pShaderBlock);
+void cStateGame::RenderEffects(tetris::timepoint_t now)
+{
+  // Each cleared line flashes white where it was, the flash fades out and shrinks to the middle of the row
+  effectQuads.clear();
 
-          pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
+  const size_t n = animations.GetCount();
+  for (size_t i = 0; i < n; i++) {
+    const cAnimation& animation = animations.Get(i);
+    if (animation.type != ANIMATION::LINE_CLEAR) continue;
+
+    assert(animation.board < boardRepresentations.size());
+    const cBoardRepresentation& boardRepresentation = *boardRepresentations[animation.board];
+    const tetris::cBoardSnapshot& board = simulation.GetSnapshot().boards[boardRepresentation.index];
+
+    const float t = cAnimationTimeline::GetProgress(animation, now);
+    const float fBlockSize = 0.015f * boardRepresentation.fScale;
+    const float fHeight = fBlockSize * (1.0f - t);
+
+    // Rows count up from the bottom of the board
+    const float x = boardRepresentation.position.x;
+    const float y = boardRepresentation.position.y + (0.015f * boardRepresentation.fScale * animations.GetBoardOffsetBlocks(boardRepresentation.index, now)) + (fBlockSize * (float(board.GetHeight()) - 1.0f - float(animation.value))) + (0.5f * (fBlockSize - fHeight));
+
+    cBlockQuad quad;
+    quad.size = spitfire::math::cVec2(fBlockSize, fHeight);
+    quad.colour = spitfire::math::cColour(1.0f, 1.0f, 1.0f, 1.0f - t);
+    for (size_t column = 0; column < board.GetWidth(); column++) {
+      quad.position = spitfire::math::cVec2(x + (fBlockSize * float(column)), y);
+      effectQuads.push_back(quad);
+    }
+  }
 
-          pContext->BindStaticVertexBufferObject2D(vertexBufferObjectPieceTriangles);
-          pContext->DrawStaticVertexBufferObjectTriangles2D(vertexBufferObjectPieceTriangles);
-          pContext->UnBindStaticVertexBufferObject2D(vertexBufferObjectPieceTriangles);
+  if (effectQuads.empty()) return;
 
-          pContext->UnBindShader(*pShaderBlock);
+  blockRenderer.UpdateQuadGeometry(effectGeometry, effectQuads);
 
-          pContext->UnBindTexture(0, *pTextureBlock);
-        }
+  const spitfire::math::cVec2 position(0.0f, 0.0f);
+  renderQueue.AddPieceGeometry(effectGeometry, position);
 
-        breathe::render::cVertexBufferObject& vertexBufferObjectNextPieceTriangles = pBoardRepresentation->vertexBufferObjectNextPieceTriangles;
-        if (vertexBufferObjectNextPieceTriangles.IsCompiled()) {
-          spitfire::math::cMat4 matModelView2D;
-          matModelView2D.SetTranslation(x + (0.015f * float(pBoardRepresentation->board.GetWidth())) + (0.015f * 3.0f), y + (0.015f * (0.5f * float(pBoardRepresentation->board.GetHeight()))), 0.0f);
+  spitfire::math::cMat4 matModelView2D;
 
-          pContext->BindTexture(0, *pTextureBlock);
+  pContext->EnableBlending();
 
-          pContext->BindShader(*pShaderBlock);
+  pContext->BindTexture(0, *pTextureBlock);
 
-          pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
+  pContext->BindShader(*pShaderBlock);
 
-          pContext->BindStaticVertexBufferObject2D(vertexBufferObjectNextPieceTriangles);
-          pContext->DrawStaticVertexBufferObjectTriangles2D(vertexBufferObjectNextPieceTriangles);
-          pContext->UnBindStaticVertexBufferObject2D(vertexBufferObjectNextPieceTriangles);
+  pContext->SetShaderProjectionAndModelViewMatricesRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO, matModelView2D);
 
-          pContext->UnBindShader(*pShaderBlock);
+  blockRenderer.Submit(renderQueue);
 
-          pContext->UnBindTexture(0, *pTextureBlock);
-        }
+  pContext->UnBindShader(*pShaderBlock);
 
-        x += 0.4f;
-      }
+  pContext->UnBindTexture(0, *pTextureBlock);
+
+  pContext->DisableBlending();
+}
+
+void cStateGame::_RenderToTexture(const spitfire::math::cTimeStep& timeStep)
+{
+  // Render the scene
+  const spitfire::math::cColour clearColour(0.392156863f, 0.584313725f, 0.929411765f);
+  pContext->SetClearColour(clearColour);
+
+  if (bIsWireframe) pContext->EnableWireframe();
+
+  {
+    pContext->BeginRenderMode2D(breathe::render::MODE2D_TYPE::Y_INCREASES_DOWN_SCREEN_KEEP_ASPECT_RATIO);
+
+    // Draw the boards
+    {
+      const tetris::cGameSnapshot& snapshot = simulation.GetSnapshot();
+      assert(!snapshot.boards.empty());
+
+      RenderBoards(snapshot);
     }
 
     pContext->EndRenderMode2D();
@@ -13,7 +13,13 @@
 #include <breathe/util/joystick.h>
 
 // Tetris headers
+#include "animation.h"
 #include "application.h"
+#include "blockrenderer.h"
+#include "boardlayout.h"
+#include "input.h"
+#include "particles.h"
+#include "simulation.h"
 #include "tetris.h"
 
 class cApplication;
@@ -24,24 +30,38 @@ class cApplication;
 class cBoardRepresentation
 {
 public:
-  cBoardRepresentation(tetris::cBoard& board, const spitfire::string_t& sName);
+  cBoardRepresentation(size_t index, const spitfire::string_t& sName);
 
-  tetris::cBoard& board;
+  size_t index; // Index of the board in the simulation
   spitfire::string_t sName;
 
-  breathe::render::cVertexBufferObject vertexBufferObjectBoardTriangles;
-  breathe::render::cVertexBufferObject vertexBufferObjectPieceTriangles;
-  breathe::render::cVertexBufferObject vertexBufferObjectNextPieceTriangles;
-
-  bool bIsInputPieceMoveLeft;
-  bool bIsInputPieceMoveRight;
-  bool bIsInputPieceRotateCounterClockWise;
-  bool bIsInputPieceRotateClockWise;
-  bool bIsInputPieceDropOneRow;
-  bool bIsInputPieceDropToGround;
-
-  spitfire::durationms_t lastKeyLeft;
-  spitfire::durationms_t lastKeyRight;
+  // Where the board is drawn and in how much detail
+  spitfire::math::cVec2 position;
+  float fScale;
+  BOARD_DETAIL detail;
+
+  // The board is drawn into the render target when it changes, from one of these depending on the renderer
+  cBoardRenderTarget renderTarget;
+  bool bIsRenderTargetDirty;
+
+  // Low detail boards draw the current piece into the render target too
+  bool bIsPieceInRenderTarget;
+  size_t pieceXInRenderTarget;
+  size_t pieceYInRenderTarget;
+
+  cBoardGeometryBuffer boardGeometry;
+  cBoardTexture boardTexture;
+  cPieceGeometryBuffer pieceGeometry;
+  cPieceGeometryBuffer nextPieceGeometry;
+
+  cBlockInstanceBuffer blocksBackground;
+  cBlockInstanceBuffer blocksBoard;
+  cBlockInstanceBuffer blocksPiece;
+  cBlockInstanceBuffer blocksNextPiece;
+
+  // The ranges of the piece mesh cache to draw, if a piece is not in the cache it is built into the buffers above instead
+  cPieceMeshRange pieceMesh;
+  cPieceMeshRange nextPieceMesh;
 };
 
 
@@ -56,7 +76,22 @@ public:
   void LoadResources();
   void DestroyResources();
 
+  // Rebuilds only the resources that depend on the size of the window
+  void ResizeResources();
+
 protected:
+  virtual void _OnPause() override;
+  virtual void _OnResume() override;
+
+  // The screen is only redrawn when something has changed, otherwise we wait for the next event
+  void SetDirty() { bIsDirty = true; }
+
+  // Updates the hud offset from the spring and the gui, the state is dirty while the gui is still shaking
+  void UpdateGui(const spitfire::math::cTimeStep& timeStep);
+
+  // The longest we can wait for an event when nothing has changed, states that change without any events can wait for less
+  virtual spitfire::durationms_t _GetMaximumIdleWait() const;
+
   breathe::gui::cStaticText* AddStaticText(breathe::gui::id_t id, const spitfire::string_t& sText, float x, float y, float width);
   breathe::gui::cRetroButton* AddRetroButton(breathe::gui::id_t id, const spitfire::string_t& sText, float x, float y, float width);
   breathe::gui::cRetroInput* AddRetroInput(breathe::gui::id_t id, const spitfire::string_t& sText, float x, float y, float width);
@@ -81,10 +116,8 @@ protected:
 private:
   virtual void _OnEnter() override {}
   virtual void _OnExit() override {}
-  virtual void _OnPause() override;
-  virtual void _OnResume() override;
 
-  virtual void _OnWindowEvent(const breathe::gui::cWindowEvent& event) override {}
+  virtual void _OnWindowEvent(const breathe::gui::cWindowEvent& event) override { SetDirty(); }
   virtual void _OnMouseEvent(const breathe::gui::cMouseEvent& event) override;
   virtual void _OnKeyboardEvent(const breathe::gui::cKeyboardEvent& event) override;
   virtual void _OnJoystickEvent(const breathe::util::cJoystickEvent& event) override;
@@ -106,13 +139,30 @@ private:
   void DestroyVertexBufferObjectLetterBoxedRectangle();
 
   void CreateFrameBufferObjectLetterBoxedRectangle(size_t width, size_t height);
+  void ResizeFrameBufferObjectLetterBoxedRectangle(size_t width, size_t height);
   void DestroyFrameBufferObjectLetterBoxedRectangle();
 
   void CreateShaderLetterBoxedRectangle();
   void DestroyShaderLetterBoxedRectangle();
 
+  // The scene is only drawn to pFrameBufferObjectLetterBoxedRectangle first if it is scaled or the texture letter box mode is selected
+  bool IsRenderingToTexture(size_t width, size_t height) const;
+  void GetRenderToTextureSize(size_t width, size_t height, size_t& textureWidth, size_t& textureHeight) const;
+
+  void _RenderToScreenLetterBoxedViewport(const spitfire::math::cTimeStep& timeStep, size_t width, size_t height);
+  void _RenderToScreenLetterBoxedTexture(const spitfire::math::cTimeStep& timeStep, size_t width, size_t height);
+
+  bool bIsDirty;
+  spitfire::durationms_t lastRedrawTime;
+  spitfire::math::cVec2 hudOffsetDrawn; // The offset when the state was last made dirty by the spring
+
+  bool bIsLetterBoxUsingViewport;
+  float fRenderScale;
+
   breathe::render::cVertexBufferObject vertexBufferObjectLetterBoxedRectangle;
   breathe::render::cTextureFrameBufferObject* pFrameBufferObjectLetterBoxedRectangle;
+  size_t textureWidthLetterBoxedRectangle;
+  size_t textureHeightLetterBoxedRectangle;
   breathe::render::cShader* pShaderLetterBoxedRectangle;
 };
 
@@ -238,40 +288,89 @@ public:
 private:
   void UpdateText();
 
-  void UpdateBoardVBO(breathe::render::cVertexBufferObject& vertexBufferObject, const tetris::cBoard& board);
-  void UpdatePieceVBO(breathe::render::cVertexBufferObject& vertexBufferObject, const tetris::cBoard& board, const tetris::cPiece& piece);
+  void AddInputBindings(size_t nBoards);
+
+  void CreateBoardRepresentation(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board);
+  void DestroyBoardRepresentation(cBoardRepresentation& boardRepresentation);
+  void UpdateBoard(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board);
+  void UpdatePiece(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board);
+  void UpdateNextPiece(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board);
+
+  void QueuePiece(const cPieceMeshRange& range, const cPieceGeometryBuffer& geometry, const cBlockInstanceBuffer& blocks, const spitfire::math::cVec2& position);
+  void RenderBoardToTarget(cBoardRepresentation& boardRepresentation, const tetris::cBoardSnapshot& board);
+  void RenderBoards(const tetris::cGameSnapshot& snapshot);
+  void RenderEffects(tetris::timepoint_t now);
+  void RenderParticles(tetris::timepoint_t now);
+
+  void EmitLineParticles(const tetris::cBoardSnapshot& board, size_t nParticlesPerBlock, const spitfire::math::cColour& colour);
+  void UpdateProfilingText();
+
+
+  virtual void _OnPause() override;
+  virtual void _OnResume() override;
 
   virtual void _OnStateKeyboardEvent(const breathe::gui::cKeyboardEvent& event) override;
   virtual void _OnStateJoystickEvent(const breathe::util::cJoystickEvent& event) override;
 
   virtual void _Update(const spitfire::math::cTimeStep& timeStep) override;
-  virtual void _UpdateInput(const spitfire::math::cTimeStep& timeStep) override;
   virtual void _RenderToTexture(const spitfire::math::cTimeStep& timeStep) override;
 
-  virtual void _OnPieceMoved(const tetris::cBoard& board) override;
-  virtual void _OnPieceRotated(const tetris::cBoard& board) override;
-  virtual void _OnPieceChanged(const tetris::cBoard& board) override;
-  virtual void _OnPieceHitsGround(const tetris::cBoard& board) override;
-  virtual void _OnBoardChanged(const tetris::cBoard& board) override;
-  virtual void _OnGameScoreTetris(const tetris::cBoard& board, size_t uiScore) override;
-  virtual void _OnGameScoreOtherThanTetris(const tetris::cBoard& board, size_t uiScore) override;
-  virtual void _OnGameNewLevel(const tetris::cBoard& board, size_t uiLevel) override;
-  virtual void _OnGameOver(const tetris::cBoard& board) override;
+  virtual spitfire::durationms_t _GetMaximumIdleWait() const override;
+
+  virtual void _OnPieceMoved(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnPieceRotated(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnPieceChanged(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnPieceHitsGround(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnBoardChanged(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnGameScoreTetris(const tetris::cBoardSnapshot& board, size_t uiScore) override;
+  virtual void _OnGameScoreOtherThanTetris(const tetris::cBoardSnapshot& board, size_t uiScore) override;
+  virtual void _OnGameNewLevel(const tetris::cBoardSnapshot& board, size_t uiLevel) override;
+  virtual void _OnGameOver(const tetris::cBoardSnapshot& board) override;
+  virtual void _OnLineCleared(const tetris::cBoardSnapshot& board, size_t row) override;
+  virtual void _OnLinesAdded(const tetris::cBoardSnapshot& board, size_t lines) override;
 
   breathe::gui::cStaticText* pLevelText[4];
   breathe::gui::cStaticText* pScoreText[4];
+  breathe::gui::cStaticText* pProfilingText;
 
   breathe::render::cTexture* pTextureBlock;
 
   breathe::render::cShader* pShaderBlock;
+  breathe::render::cShader* pShaderBlockInstanced;
+  breathe::render::cShader* pShaderBoardTexture;
+  breathe::render::cShader* pShaderParticle;
   breathe::audio::cBufferRef pAudioBufferPieceHitsGround;
   breathe::audio::cBufferRef pAudioBufferScoreTetris;
   breathe::audio::cBufferRef pAudioBufferScoreOtherThanTetris;
   breathe::audio::cBufferRef pAudioBufferGameOver;
 
+  BLOCK_RENDERER blockRenderMode;
+  BLOCK_RENDERER pieceRenderMode; // Pieces are only ever geometry or instanced
+  cBlockRenderer blockRenderer;
+  cPieceMeshCache pieceMeshCache;
+  cBoardRenderTargetAtlas boardRenderTargetAtlas;
+  cBlockRenderQueue renderQueue;
+  cBlockRenderQueue renderQueueBoards; // The render targets of the boards are drawn with a different shader to the pieces
+  std::vector<cBlockInstance> instances; // Reused for each update so that we don't allocate
+
+  // Effects drawn over the top of the boards, the simulation doesn't wait for them
+  cAnimationTimeline animations;
+  cPieceGeometryBuffer effectGeometry;
+  std::vector<cBlockQuad> effectQuads; // Reused for each frame so that we don't allocate
+
   std::vector<cBoardRepresentation*> boardRepresentations;
+  size_t nPlayers; // The boards of the players are first, any other boards are spectator boards
+  size_t nFrame;
+
+  // Shards that fly out of cleared lines, they are moved once per frame just before they are drawn
+  cParticleSystem particles;
+  tetris::timepoint_t particlesUpdated;
+  std::vector<std::pair<size_t, size_t> > clearedRows; // The board and row of each line cleared since the last score event
+
+  bool bIsProfiling; // Shows the particle count and update time
 
-  tetris::cGame game;
+  tetris::cSimulation simulation;
+  tetris::cInputMapper inputMapper;
 
   bool bPauseSoon;
   bool bQuitSoon;
@@ -20,13 +20,144 @@
 
 namespace tetris
 {
+  // ** State hashing
+
+  // 64 bit FNV-1a, the bytes are fed in a fixed order so replicas on different platforms produce the same hashes
+  const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+  const uint64_t FNV_PRIME = 1099511628211ULL;
+
+  inline uint64_t HashValue(uint64_t hash, uint64_t value)
+  {
+    for (size_t i = 0; i < 8; i++) {
+      hash ^= (value & 0xFF);
+      hash *= FNV_PRIME;
+      value >>= 8;
+    }
+
+    return hash;
+  }
+
+
+  // ** cEventBuffer
+
+  void cEventBuffer::Push(EVENT type, size_t board, size_t value)
+  {
+    cEvent event;
+    event.type = type;
+    event.board = board;
+    event.value = value;
+    events.push_back(event);
+  }
+
+  void cEventBuffer::Append(const cEventBuffer& rhs)
+  {
+    events.insert(events.end(), rhs.events.begin(), rhs.events.end());
+  }
+
+  inline bool IsMergeable(EVENT type)
+  {
+    // These events just mean "this part of the board needs to be redrawn", one of them per board is enough
+    return ((type == EVENT::PIECE_MOVED) || (type == EVENT::PIECE_ROTATED) || (type == EVENT::PIECE_CHANGED) || (type == EVENT::BOARD_CHANGED));
+  }
+
+  void cEventBuffer::Coalesce()
+  {
+    std::vector<cEvent> merged;
+    merged.reserve(events.size());
+
+    const size_t n = events.size();
+    for (size_t i = 0; i < n; i++) {
+      const cEvent& event = events[i];
+      if (IsMergeable(event.type)) {
+        // A piece changed event rebuilds everything that a piece rotated or moved event would
+        bool bIsDuplicate = false;
+        for (size_t j = 0; j < n; j++) {
+          const cEvent& other = events[j];
+          if (other.board != event.board) continue;
+
+          if ((other.type == event.type) && (j < i)) bIsDuplicate = true;
+          else if ((other.type == EVENT::PIECE_CHANGED) && ((event.type == EVENT::PIECE_ROTATED) || (event.type == EVENT::PIECE_MOVED))) bIsDuplicate = true;
+          else if ((other.type == EVENT::PIECE_ROTATED) && (event.type == EVENT::PIECE_MOVED)) bIsDuplicate = true;
+
+          if (bIsDuplicate) break;
+        }
+
+        if (bIsDuplicate) continue;
+      }
+
+      merged.push_back(event);
+    }
+
+    events.swap(merged);
+  }
+
+  void cEventBuffer::Dispatch(const cGameSnapshot& snapshot, cView& view) const
+  {
+    const size_t n = events.size();
+    for (size_t i = 0; i < n; i++) {
+      const cEvent& event = events[i];
+      assert(event.board < snapshot.boards.size());
+      const cBoardSnapshot& board = snapshot.boards[event.board];
+
+      switch (event.type) {
+        case EVENT::PIECE_MOVED: view.OnPieceMoved(board); break;
+        case EVENT::PIECE_ROTATED: view.OnPieceRotated(board); break;
+        case EVENT::PIECE_CHANGED: view.OnPieceChanged(board); break;
+        case EVENT::PIECE_HITS_GROUND: view.OnPieceHitsGround(board); break;
+        case EVENT::BOARD_CHANGED: view.OnBoardChanged(board); break;
+        case EVENT::SCORE_TETRIS: view.OnGameScoreTetris(board, event.value); break;
+        case EVENT::SCORE_OTHER_THAN_TETRIS: view.OnGameScoreOtherThanTetris(board, event.value); break;
+        case EVENT::NEW_LEVEL: view.OnGameNewLevel(board, event.value); break;
+        case EVENT::GAME_OVER: view.OnGameOver(board); break;
+        case EVENT::LINE_CLEARED: view.OnLineCleared(board, event.value); break;
+        case EVENT::LINES_ADDED: view.OnLinesAdded(board, event.value); break;
+      }
+    }
+  }
+
+
   // ** cGame
 
-  cGame::cGame(cView& _view) :
-    view(_view)
+  cGame::cGame() :
+    tick(0),
+    random(1)
   {
   }
 
+  size_t cGame::GetRandom(size_t n)
+  {
+    if (n == 0) return 0;
+
+    // xorshift64*, the same sequence on every platform
+    random ^= random >> 12;
+    random ^= random << 25;
+    random ^= random >> 27;
+    return size_t(((random * 0x2545f4914f6cdd1dull) >> 32) % n);
+  }
+
+  size_t cGame::GetBoardIndex(const cBoard& board) const
+  {
+    const size_t n = boards.size();
+    for (size_t i = 0; i < n; i++) {
+      if (boards[i] == &board) return i;
+    }
+
+    assert(false);
+    return BOARD_INDEX_NONE;
+  }
+
+  void cGame::_PushEvent(EVENT type, const cBoard& board, size_t value)
+  {
+    // An event from a board that isn't in this game would be sent to the views as another board's event, so it is dropped
+    const size_t index = GetBoardIndex(board);
+    if (index == BOARD_INDEX_NONE) {
+      std::cout<<"cGame::_PushEvent Dropping an event from a board that is not in this game"<<std::endl;
+      return;
+    }
+
+    events.Push(type, index, value);
+  }
+
   void cGame::_AddRandomLinesToEveryOtherBoard(const cBoard& board, size_t lines)
   {
     // Add a random line to every other board that is still playing and not our board
@@ -38,6 +169,8 @@ namespace tetris
       temp = *iter;
       if ((const_cast<const cBoard*>(temp) != pBoard) && (!temp->IsFinished())) {
         for (size_t i = 0; i < lines; i++) temp->AddRandomLineAddEnd();
+
+        _PushEvent(EVENT::LINES_ADDED, *temp, lines);
       }
       iter++;
     }
@@ -47,43 +180,72 @@ namespace tetris
   {
     _AddRandomLinesToEveryOtherBoard(board, 4);
 
-    view.OnGameScoreTetris(board, 4);
+    _PushEvent(EVENT::SCORE_TETRIS, board, 4);
   }
 
   void cGame::OnScoreOtherThanTetris(const cBoard& board, size_t lines)
   {
     _AddRandomLinesToEveryOtherBoard(board, lines);
 
-    view.OnGameScoreOtherThanTetris(board, lines);
+    _PushEvent(EVENT::SCORE_OTHER_THAN_TETRIS, board, lines);
+  }
+
+  void cGame::OnPieceMoved(const cBoard& board)
+  {
+    _PushEvent(EVENT::PIECE_MOVED, board, 0);
   }
 
   void cGame::OnPieceRotated(const cBoard& board)
   {
-    view.OnPieceRotated(board);
+    _PushEvent(EVENT::PIECE_ROTATED, board, 0);
   }
 
   void cGame::OnPieceHitsGround(const cBoard& board)
   {
-    view.OnPieceHitsGround(board);
+    _PushEvent(EVENT::PIECE_HITS_GROUND, board, 0);
   }
 
   void cGame::OnPieceChanged(const cBoard& board)
   {
-    view.OnPieceChanged(board);
+    _PushEvent(EVENT::PIECE_CHANGED, board, 0);
   }
 
   void cGame::OnBoardChanged(const cBoard& board)
   {
-    view.OnBoardChanged(board);
+    _PushEvent(EVENT::BOARD_CHANGED, board, 0);
+  }
+
+  void cGame::OnLineCleared(const cBoard& board, size_t row)
+  {
+    _PushEvent(EVENT::LINE_CLEARED, board, row);
   }
 
   void cGame::OnGameOver(const cBoard& board)
   {
-    view.OnGameOver(board);
+    _PushEvent(EVENT::GAME_OVER, board, 0);
+  }
+
+  void cGame::TakeEvents(cEventBuffer& rhs)
+  {
+    rhs.Append(events);
+    events.Clear();
+  }
+
+  void cGame::GetSnapshot(cGameSnapshot& snapshot) const
+  {
+    snapshot.tick = tick;
+
+    const size_t n = boards.size();
+    snapshot.boards.resize(n);
+    for (size_t i = 0; i < n; i++) snapshot.boards[i].CopyFrom(i, *(boards[i]));
   }
 
   void cGame::StartGame(spitfire::durationms_t currentTime)
   {
+    // Seeded from the start time so that replays and replicas started at the same time play out the same, xorshift needs a
+    // state that isn't zero
+    random = (uint64_t(currentTime) * 0x9e3779b97f4a7c15ull) | 1;
+
     const size_t width = 10;
     const size_t height = 40;
 
@@ -171,6 +333,8 @@ namespace tetris
 
       iter++;
     }
+
+    tick = 0;
   }
 
   void cGame::Update(spitfire::durationms_t currentTime)
@@ -183,6 +347,8 @@ namespace tetris
 
       iter++;
     }
+
+    tick++;
   }
 
 
@@ -375,6 +541,17 @@ namespace tetris
     blocks.resize(width * height, 0);
   }
 
+  uint64_t cPiece::GetStateHash(uint64_t hash) const
+  {
+    hash = HashValue(hash, width);
+    hash = HashValue(hash, height);
+
+    const size_t n = blocks.size();
+    for (size_t i = 0; i < n; i++) hash = HashValue(hash, uint64_t(blocks[i]));
+
+    return hash;
+  }
+
 
   // ** cBoard
 
@@ -387,8 +564,13 @@ namespace tetris
     current_y(0),
 
     state(STATE_FINISHED),
+    score(0),
+    level(1),
+    rows_this_level(0),
+
+    lastUpdatedTime(0),
 
-    rows_this_level(0)
+    revision(0)
   {
     AddPossibleColour("", spitfire::math::cColour());
   }
@@ -396,7 +578,8 @@ namespace tetris
   cBoard::~cBoard()
   {
     possible_colours.clear();
-    possible_pieces.Clear();
+    possible_pieces.clear();
+    piece_bucket.clear();
   }
 
   void cBoard::CopySettingsFrom(const cBoard& rhs)
@@ -404,11 +587,14 @@ namespace tetris
     board = rhs.board;
 
     possible_pieces = rhs.possible_pieces;
+    piece_bucket = rhs.piece_bucket;
     possible_colour_names = rhs.possible_colour_names;
     possible_colours = rhs.possible_colours;
 
     widest_piece = rhs.widest_piece;
     state = rhs.state;
+
+    _SetRowsChanged(0, board.GetHeight());
   }
 
   void cBoard::StartGame(spitfire::durationms_t currentTime)
@@ -422,6 +608,7 @@ namespace tetris
 
     // Clear the board
     board.Clear();
+    piece_bucket.clear();
 
     if (board.GetWidth() == 0) std::cout<<"cBoard::StartGame Width not defined"<<std::endl;
     if ((board.GetHeight()>>1) == 0) std::cout<<"cBoard::StartGame Height not defined"<<std::endl;
@@ -434,9 +621,11 @@ namespace tetris
 
     // Add some random blocks to make it interesting at the start
     for (size_t i = 0; i < 60; i++) {
-      board.SetBlock(spitfire::math::random(int(board.GetWidth())), spitfire::math::random(int(board.GetHeight()>>1)), spitfire::math::random(int(GetColours())));
+      board.SetBlock(game.GetRandom(board.GetWidth()), game.GetRandom(board.GetHeight()>>1), int(game.GetRandom(GetColours())));
     }
 
+    _SetRowsChanged(0, board.GetHeight());
+
     PieceGenerate(currentTime);
     PieceGenerate(currentTime);
   }
@@ -444,7 +633,7 @@ namespace tetris
   void cBoard::Update(spitfire::durationms_t currentTime)
   {
     // If we have wait a sufficient amount of time, then do an update
-    if ((currentTime - lastUpdatedTime) > (1500 / level)) {
+    if ((currentTime - lastUpdatedTime) > GetDropInterval()) {
       lastUpdatedTime = currentTime;
 
       if (state != STATE_FINISHED) PieceDropOneRow(currentTime);
@@ -486,17 +675,24 @@ namespace tetris
   {
     assert(row <= board.GetHeight());
     board.RemoveLine(row);
+
+    // Every row above this one has moved down
+    _SetRowsChanged(row, board.GetHeight());
   }
 
   void cBoard::_CheckForCompleteLines()
   {
     size_t row = 0;
     size_t consecutive = 0;
+    size_t removed = 0;
     for (row = 0; row < board.GetHeight(); row++) {
       consecutive = 0;
       while (_IsCompleteLine(row)) {
+        // Every line that we have already removed was below this one, so it was this many rows further up before they went
+        game.OnLineCleared(*this, row + removed);
         _RemoveLine(row);
         consecutive++;
+        removed++;
       }
 
       // If we actually have one or more complete rows then add them to our score
@@ -521,6 +717,18 @@ namespace tetris
         if (colour != 0) board.SetBlock(x2, y2, colour);
       }
     }
+
+    _SetRowsChanged(current_y - height, std::min(current_y, board.GetHeight()));
+  }
+
+  void cBoard::_SetRowsChanged(size_t first, size_t last)
+  {
+    // The board can grow when a block is set outside of it
+    const size_t height = board.GetHeight();
+    if (rowRevisions.size() != height) rowRevisions.resize(height, 0);
+
+    revision++;
+    for (size_t row = first; (row < last) && (row < height); row++) rowRevisions[row] = revision;
   }
 
   void cBoard::_AddPieceToBoardCheckAndGenerate(spitfire::durationms_t currentTime)
@@ -538,7 +746,8 @@ namespace tetris
     game.OnBoardChanged(*this);
   }
 
-  bool cBoard::_IsCollided(const cPiece& rhs, size_t position_x, size_t position_y) const
+  // Shared by the board and its snapshots
+  inline bool IsCollided(const cPiece& board, const cPiece& rhs, size_t position_x, size_t position_y)
   {
     if (position_x > board.GetWidth() - rhs.GetWidth()) return true;
 
@@ -557,14 +766,23 @@ namespace tetris
     return false;
   }
 
+  bool cBoard::_IsCollided(const cPiece& rhs, size_t position_x, size_t position_y) const
+  {
+    return IsCollided(board, rhs, position_x, position_y);
+  }
+
   void cBoard::SetWidth(size_t _width)
   {
     board.SetWidth(_width);
+
+    _SetRowsChanged(0, board.GetHeight());
   }
 
   void cBoard::SetHeight(size_t _height)
   {
     board.SetHeight(_height);
+
+    _SetRowsChanged(0, board.GetHeight());
   }
 
   void cBoard::AddPossibleColour(const std::string& name, const spitfire::math::cColour& colour)
@@ -575,13 +793,15 @@ namespace tetris
 
   void cBoard::AddPossiblePiece(const cPiece& piece)
   {
-    possible_pieces.AddItem(piece);
+    possible_pieces.push_back(piece);
     widest_piece = std::max(std::max(widest_piece, piece.GetWidth()), piece.GetHeight());
   }
 
   void cBoard::SetBlock(size_t x, size_t y, int colour)
   {
     board.SetBlock(x, y, colour);
+
+    _SetRowsChanged(y, y + 1);
   }
 
   int cBoard::GetBlock(size_t x, size_t y) const
@@ -608,7 +828,14 @@ namespace tetris
   {
     current_piece = next_piece;
 
-    next_piece = possible_pieces.GetRandomItem();
+    // Every piece comes out once before any piece comes out again
+    if (piece_bucket.empty()) piece_bucket.assign(possible_pieces.begin(), possible_pieces.end());
+    assert(!piece_bucket.empty());
+
+    const size_t i = game.GetRandom(piece_bucket.size());
+    next_piece = piece_bucket[i];
+    piece_bucket[i] = piece_bucket.back();
+    piece_bucket.pop_back();
     std::cout<<"cBoard::PieceGenerate Adding piece which is "<<next_piece.GetWidth()<<" by "<<next_piece.GetHeight()<<std::endl;
 
     current_x = (board.GetWidth()>>1) - (current_piece.GetWidth()>>1);
@@ -675,14 +902,14 @@ namespace tetris
     for (i = 0; i < n; i ++) possible_blocks.push_back(0);
 
     n = width;
-    for (; i < n; i++) possible_blocks.push_back(spitfire::math::random(int(possible_colours_n)));
+    for (; i < n; i++) possible_blocks.push_back(int(game.GetRandom(possible_colours_n)));
 
     size_t colour = 0;
     n = width - 1;
     //size_t startingCount = possible_blocks.size();
     for (i = 0; i < n; i++) {
       size_t count = possible_blocks.size();
-      colour = GetListElement(possible_blocks, spitfire::math::random(int(count)));
+      colour = GetListElement(possible_blocks, game.GetRandom(count));
       assert(colour < possible_colours.size());
       board.SetBlock(i, 0, int(colour));
     }
@@ -691,27 +918,153 @@ namespace tetris
     assert(colour < possible_colours.size());
     board.SetBlock(i, 0, int(colour));
 
+    // Every row has moved up
+    _SetRowsChanged(0, board.GetHeight());
+
     game.OnBoardChanged(*this);
   }
 
 
 
+  uint64_t cBoard::GetStateHash() const
+  {
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = HashValue(hash, uint64_t(state));
+    hash = HashValue(hash, score);
+    hash = HashValue(hash, level);
+    hash = HashValue(hash, rows_this_level);
+    hash = HashValue(hash, current_x);
+    hash = HashValue(hash, current_y);
+
+    // Included so that any dependence on the wall clock shows up as a desync
+    hash = HashValue(hash, lastUpdatedTime);
+
+    hash = board.GetStateHash(hash);
+    hash = current_piece.GetStateHash(hash);
+    hash = next_piece.GetStateHash(hash);
+
+    return hash;
+  }
+
+  inline void DumpPiece(std::ostream& o, const cPiece& piece)
+  {
+    // Print the top row first so that the dump looks like the board on screen
+    const size_t width = piece.GetWidth();
+    const size_t height = piece.GetHeight();
+    for (size_t y = height; y > 0; y--) {
+      o<<"  ";
+      for (size_t x = 0; x < width; x++) {
+        const int colour = piece.GetBlock(x, y - 1);
+        if (colour == 0) o<<'.';
+        else o<<colour;
+      }
+      o<<std::endl;
+    }
+  }
+
+  void cBoard::DumpState(std::ostream& o) const
+  {
+    o<<"state="<<int(state)<<" score="<<score<<" level="<<level<<" rows_this_level="<<rows_this_level<<" lastUpdatedTime="<<lastUpdatedTime<<std::endl;
+    o<<"current piece at "<<current_x<<","<<current_y<<std::endl;
+    DumpPiece(o, current_piece);
+    o<<"next piece"<<std::endl;
+    DumpPiece(o, next_piece);
+    o<<"board"<<std::endl;
+    DumpPiece(o, board);
+  }
+
+
+  // ** cBoardSnapshot
+
+  cBoardSnapshot::cBoardSnapshot() :
+    index(0),
+    current_x(0),
+    current_y(0),
+    state(STATE_FINISHED),
+    score(0),
+    level(1),
+    lastUpdatedTime(0)
+  {
+  }
+
+  void cBoardSnapshot::CopyFrom(size_t _index, const cBoard& rhs)
+  {
+    index = _index;
+
+    // These are assigned rather than constructed so that the snapshot reuses its memory from the last time
+    possible_colours = rhs.possible_colours;
+    rowRevisions = rhs.rowRevisions;
+
+    board = rhs.board;
+    current_piece = rhs.current_piece;
+    next_piece = rhs.next_piece;
+
+    current_x = rhs.current_x;
+    current_y = rhs.current_y;
+
+    state = rhs.state;
+    score = rhs.score;
+    level = rhs.level;
+
+    lastUpdatedTime = rhs.lastUpdatedTime;
+  }
+
+  bool cBoardSnapshot::CanPieceDrop() const
+  {
+    // The same tests as cBoard::PieceDropOneRow
+    if (!IsPlaying()) return false;
+    if ((int(current_y) - int(current_piece.GetHeight())) <= 0) return false;
+
+    return !IsCollided(board, current_piece, current_x, current_y - 1);
+  }
+
+
+  // ** cGameSnapshot
+
+  cGameSnapshot::cGameSnapshot() :
+    tick(0),
+    currentTime(0)
+  {
+  }
+
+
   // *** Input
 
+  void cBoard::ApplyInput(INPUT input, spitfire::durationms_t currentTime)
+  {
+    switch (input) {
+      case INPUT::PIECE_MOVE_LEFT: PieceMoveLeft(); break;
+      case INPUT::PIECE_MOVE_RIGHT: PieceMoveRight(); break;
+      case INPUT::PIECE_ROTATE_COUNTER_CLOCKWISE: PieceRotateCounterClockWise(); break;
+      case INPUT::PIECE_ROTATE_CLOCKWISE: PieceRotateClockWise(); break;
+      case INPUT::PIECE_DROP_ONE_ROW: PieceDropOneRow(currentTime); break;
+      case INPUT::PIECE_DROP_TO_GROUND: PieceDropToGround(currentTime); break;
+    }
+  }
+
   void cBoard::PieceMoveLeft()
   {
     if (state != STATE_PLAYING) return;
 
+    const size_t previous_x = current_x;
+
     if (current_x > 0) current_x--;
     if (_IsCollided(current_piece, current_x, current_y)) current_x++;
+
+    if (current_x != previous_x) game.OnPieceMoved(*this);
   }
 
   void cBoard::PieceMoveRight()
   {
     if (state != STATE_PLAYING) return;
 
+    const size_t previous_x = current_x;
+
     current_x = std::min(current_x + 1, board.GetWidth() - current_piece.GetWidth());
     if (_IsCollided(current_piece, current_x, current_y)) current_x--;
+
+    if (current_x != previous_x) game.OnPieceMoved(*this);
   }
 
   void cBoard::PieceRotateCounterClockWise()
@@ -761,6 +1114,8 @@ namespace tetris
       _AddPieceToBoardCheckAndGenerate(currentTime);
       return;
     }
+
+    game.OnPieceMoved(*this);
   }
 
   void cBoard::PieceDropToGround(spitfire::durationms_t currentTime)
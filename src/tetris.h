@@ -1,6 +1,9 @@
 #ifndef TETRIS_H
 #define TETRIS_H
 
+// Standard headers
+#include <chrono>
+
 // Spitfire headers
 #include <spitfire/spitfire.h>
 
@@ -13,32 +16,118 @@
 namespace tetris
 {
   class cBoard;
+  class cGameSnapshot;
   class cView;
 
+  // ** Inputs
+
+  enum class INPUT {
+    PIECE_MOVE_LEFT,
+    PIECE_MOVE_RIGHT,
+    PIECE_ROTATE_COUNTER_CLOCKWISE,
+    PIECE_ROTATE_CLOCKWISE,
+    PIECE_DROP_ONE_ROW,
+    PIECE_DROP_TO_GROUND,
+  };
+
+  const size_t INPUT_COUNT = 6;
+
+  const size_t BOARD_INDEX_NONE = size_t(-1);
+
+  // ** Events
+  //
+  // The game appends events to a buffer while it is updating, they are sent to the view afterwards with
+  // cEventBuffer::Dispatch so that the simulation never has to wait for the presentation
+
+  enum class EVENT {
+    PIECE_MOVED,
+    PIECE_ROTATED,
+    PIECE_CHANGED,
+    PIECE_HITS_GROUND,
+    BOARD_CHANGED,
+    SCORE_TETRIS,
+    SCORE_OTHER_THAN_TETRIS,
+    NEW_LEVEL,
+    GAME_OVER,
+    LINE_CLEARED,
+    LINES_ADDED,
+  };
+
+  class cEvent
+  {
+  public:
+    EVENT type;
+    size_t board; // Index into cGame::boards
+    size_t value; // Lines, level or row depending on the type
+  };
+
+  class cEventBuffer
+  {
+  public:
+    bool IsEmpty() const { return events.empty(); }
+    const std::vector<cEvent>& GetEvents() const { return events; }
+
+    void Push(EVENT type, size_t board, size_t value);
+    void Append(const cEventBuffer& rhs);
+    void Clear() { events.clear(); }
+    void Swap(cEventBuffer& rhs) { events.swap(rhs.events); }
+
+    void Coalesce();
+
+    // The events are sent along with the snapshot of the board that they refer to
+    void Dispatch(const cGameSnapshot& snapshot, cView& view) const;
+
+  private:
+    std::vector<cEvent> events;
+  };
+
   class cGame
   {
   public:
-    cGame(cView& view);
+    cGame();
 
     typedef std::vector<cBoard*>::iterator iterator;
 
     void OnScoreTetris(const cBoard& rhs);
     void OnScoreOtherThanTetris(const cBoard& rhs, size_t lines);
+    void OnPieceMoved(const cBoard& rhs);
     void OnPieceRotated(const cBoard& rhs);
     void OnPieceHitsGround(const cBoard& rhs);
     void OnPieceChanged(const cBoard& board);
     void OnBoardChanged(const cBoard& board);
+    void OnLineCleared(const cBoard& board, size_t row);
     void OnGameOver(const cBoard& rhs);
 
+    // Returns BOARD_INDEX_NONE if the board is not in this game
+    size_t GetBoardIndex(const cBoard& board) const;
+
+    void TakeEvents(cEventBuffer& rhs);
+    void ClearEvents() { events.Clear(); }
+
+    void GetSnapshot(cGameSnapshot& snapshot) const;
+
     std::vector<cBoard*> boards;
 
     void StartGame(spitfire::durationms_t currentTime);
     void Update(spitfire::durationms_t currentTime);
 
+    // The number of times Update has been called since StartGame, used to line up state hashes between replicas
+    uint64_t GetTick() const { return tick; }
+
+    // Returns a number from 0 to n - 1.  Every random choice in the game comes from here instead of the global random number
+    // generator so that replicas started at the same time are given the same pieces however their updates are interleaved
+    size_t GetRandom(size_t n);
+
   private:
     void _AddRandomLinesToEveryOtherBoard(const cBoard& rhs, size_t lines);
 
-    cView& view;
+    void _PushEvent(EVENT type, const cBoard& board, size_t value);
+
+    cEventBuffer events;
+
+    uint64_t tick;
+
+    uint64_t random; // xorshift state, seeded from the start time in StartGame
   };
 
   class cPiece
@@ -68,6 +157,8 @@ namespace tetris
     void ShiftUpOneRow();
     void FlipVertically();
 
+    uint64_t GetStateHash(uint64_t hash) const;
+
   private:
     void _Resize(size_t width, size_t height);
 
@@ -104,6 +195,9 @@ namespace tetris
     size_t GetLevel() const { return level; }
     void SetNextLevel() { level++; }
 
+    // How long the piece waits on each row before it falls to the next one
+    spitfire::durationms_t GetDropInterval() const { return 1500 / level; }
+
     size_t GetWidth() const { return board.GetWidth(); }
     size_t GetHeight() const { return board.GetHeight(); }
     size_t GetWidestPiece() const { return widest_piece; }
@@ -136,11 +230,17 @@ namespace tetris
     void PieceDropOneRow(spitfire::durationms_t currentTime);
     void PieceDropToGround(spitfire::durationms_t currentTime);
 
-#define BUILD_DEBUG
-#ifdef BUILD_DEBUG
-    // For printing out as debug information
-    const std::list<cPiece>& GetPossiblePieces() const { return possible_pieces.GetPossibleItems(); }
-#endif
+    void ApplyInput(INPUT input, spitfire::durationms_t currentTime);
+
+    // Incremented each time a row of the board changes so that views can update just the rows that have changed
+    uint64_t GetRowRevision(size_t row) const { assert(row < rowRevisions.size()); return rowRevisions[row]; }
+
+    // For comparing replicas of this board in lockstep games
+    uint64_t GetStateHash() const;
+    void DumpState(std::ostream& o) const;
+
+    // The pieces that are randomly chosen from, for printing out as debug information and for building meshes up front
+    const std::list<cPiece>& GetPossiblePieces() const { return possible_pieces; }
 
   private:
     void _AddPieceToScore();
@@ -155,11 +255,14 @@ namespace tetris
     void _AddPieceToBoardCheckAndGenerate(spitfire::durationms_t currentTime);
     void _AddPieceToBoard();
 
+    void _SetRowsChanged(size_t first, size_t last); // Half open, last is one past the last row that changed
+
     cGame& game;
 
     std::vector<std::string> possible_colour_names;
     std::vector<spitfire::math::cColour> possible_colours;
-    spitfire::cRandomBucket<cPiece> possible_pieces;
+    std::list<cPiece> possible_pieces;
+    std::vector<cPiece> piece_bucket; // The pieces that haven't come out since the bucket was last filled
     size_t widest_piece;
 
     cPiece board;
@@ -176,8 +279,89 @@ namespace tetris
 
     spitfire::durationms_t lastUpdatedTime;
 
+    uint64_t revision;
+    std::vector<uint64_t> rowRevisions;
+
     cBoard();
     NO_COPY(cBoard);
+
+    friend class cBoardSnapshot;
+  };
+
+
+  // ** cBoardSnapshot
+  //
+  // A copy of everything needed to present a board, the simulation publishes these so that it can keep changing the
+  // real boards while they are being drawn
+
+  class cBoardSnapshot
+  {
+  public:
+    cBoardSnapshot();
+
+    void CopyFrom(size_t index, const cBoard& board);
+
+    size_t GetIndex() const { return index; }
+
+    bool IsPlaying() const { return (state == STATE_PLAYING); }
+    bool IsFinished() const { return (state == STATE_FINISHED); }
+
+    size_t GetScore() const { return score; }
+    size_t GetLevel() const { return level; }
+
+    size_t GetWidth() const { return board.GetWidth(); }
+    size_t GetHeight() const { return board.GetHeight(); }
+
+    spitfire::math::cColour GetColour(size_t i) const { assert(i < possible_colours.size()); return possible_colours[i]; }
+    size_t GetColours() const { return possible_colours.size(); }
+
+    int GetBlock(size_t x, size_t y) const { return board.GetBlock(x, y); }
+
+    uint64_t GetRowRevision(size_t row) const { assert(row < rowRevisions.size()); return rowRevisions[row]; }
+
+    size_t GetCurrentPieceX() const { return current_x; }
+    size_t GetCurrentPieceY() const { return current_y; }
+
+    // The piece falls to the next row once GetDropInterval has passed since GetLastDropTime, if there is room for it
+    spitfire::durationms_t GetLastDropTime() const { return lastUpdatedTime; }
+    spitfire::durationms_t GetDropInterval() const { return 1500 / level; }
+    bool CanPieceDrop() const;
+
+    const cPiece& GetBoard() const { return board; }
+    const cPiece& GetCurrentPiece() const { return current_piece; }
+    const cPiece& GetNextPiece() const { return next_piece; }
+
+  private:
+    size_t index;
+
+    std::vector<uint64_t> rowRevisions;
+
+    std::vector<spitfire::math::cColour> possible_colours;
+
+    cPiece board;
+    cPiece current_piece;
+    cPiece next_piece;
+
+    size_t current_x;
+    size_t current_y;
+
+    STATE state;
+    size_t score;
+    size_t level;
+
+    spitfire::durationms_t lastUpdatedTime;
+  };
+
+  class cGameSnapshot
+  {
+  public:
+    cGameSnapshot();
+
+    uint64_t tick;
+    spitfire::durationms_t currentTime;
+    std::chrono::steady_clock::time_point tickTime; // When the tick was due, currentTime has moved on by the time since then
+
+    std::vector<cBoardSnapshot> boards;
   };
 
 
@@ -186,27 +370,32 @@ namespace tetris
   public:
     virtual ~cView() {}
 
-    void OnPieceMoved(const cBoard& board) { _OnPieceMoved(board); }
-    void OnPieceRotated(const cBoard& board) { _OnPieceRotated(board); }
-    void OnPieceChanged(const cBoard& board) { _OnPieceChanged(board); }
-    void OnPieceHitsGround(const cBoard& board) { _OnPieceHitsGround(board); }
-    void OnBoardChanged(const cBoard& board) { _OnBoardChanged(board); }
-    void OnGameScoreTetris(const cBoard& board, size_t uiScore) { _OnGameScoreTetris(board, uiScore); }
-    void OnGameScoreOtherThanTetris(const cBoard& board, size_t uiScore) { _OnGameScoreOtherThanTetris(board, uiScore); }
-    void OnGameNewLevel(const cBoard& board, size_t uiLevel) { _OnGameNewLevel(board, uiLevel); }
-    void OnGameOver(const cBoard& board) { _OnGameOver(board); }
+    void OnPieceMoved(const cBoardSnapshot& board) { _OnPieceMoved(board); }
+    void OnPieceRotated(const cBoardSnapshot& board) { _OnPieceRotated(board); }
+    void OnPieceChanged(const cBoardSnapshot& board) { _OnPieceChanged(board); }
+    void OnPieceHitsGround(const cBoardSnapshot& board) { _OnPieceHitsGround(board); }
+    void OnBoardChanged(const cBoardSnapshot& board) { _OnBoardChanged(board); }
+    void OnGameScoreTetris(const cBoardSnapshot& board, size_t uiScore) { _OnGameScoreTetris(board, uiScore); }
+    void OnGameScoreOtherThanTetris(const cBoardSnapshot& board, size_t uiScore) { _OnGameScoreOtherThanTetris(board, uiScore); }
+    void OnGameNewLevel(const cBoardSnapshot& board, size_t uiLevel) { _OnGameNewLevel(board, uiLevel); }
+    void OnGameOver(const cBoardSnapshot& board) { _OnGameOver(board); }
+    void OnLineCleared(const cBoardSnapshot& board, size_t row) { _OnLineCleared(board, row); }
+    void OnLinesAdded(const cBoardSnapshot& board, size_t lines) { _OnLinesAdded(board, lines); }
 
   private:
-    virtual void _OnPieceMoved(const cBoard& board) = 0;
-    virtual void _OnPieceRotated(const cBoard& board) = 0;
-    virtual void _OnPieceChanged(const cBoard& board) = 0;
-    virtual void _OnPieceHitsGround(const cBoard& board) = 0;
-    virtual void _OnBoardChanged(const cBoard& board) = 0;
-    virtual void _OnGameScoreTetris(const cBoard& board, size_t uiScore) = 0;
-    virtual void _OnGameScoreOtherThanTetris(const cBoard& board, size_t uiScore) = 0;
-    virtual void _OnGameNewLevel(const cBoard& board, size_t uiLevel) = 0;
-    virtual void _OnGameOver(const cBoard& board) = 0;
+    virtual void _OnPieceMoved(const cBoardSnapshot& board) = 0;
+    virtual void _OnPieceRotated(const cBoardSnapshot& board) = 0;
+    virtual void _OnPieceChanged(const cBoardSnapshot& board) = 0;
+    virtual void _OnPieceHitsGround(const cBoardSnapshot& board) = 0;
+    virtual void _OnBoardChanged(const cBoardSnapshot& board) = 0;
+    virtual void _OnGameScoreTetris(const cBoardSnapshot& board, size_t uiScore) = 0;
+    virtual void _OnGameScoreOtherThanTetris(const cBoardSnapshot& board, size_t uiScore) = 0;
+    virtual void _OnGameNewLevel(const cBoardSnapshot& board, size_t uiLevel) = 0;
+    virtual void _OnGameOver(const cBoardSnapshot& board) = 0;
+    virtual void _OnLineCleared(const cBoardSnapshot& board, size_t row) = 0; // The row counts up from the bottom and is where the line was before any lines were cleared
+    virtual void _OnLinesAdded(const cBoardSnapshot& board, size_t lines) = 0;
   };
+
 }
 
 #endif //TETRIS_H
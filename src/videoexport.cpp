@@ -0,0 +1,211 @@
+// Standard headers
+#include <cassert>
+#include <cstdlib>
+
+#include <string>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Tetris headers
+#include "simulation.h"
+#include "videoexport.h"
+
+namespace tetris
+{
+  namespace
+  {
+    const size_t DEFAULT_FRAMES_PER_SECOND = 60;
+  }
+
+  VIDEO_FORMAT GetVideoFormatFromFilePath(const std::string& sFilePath)
+  {
+    const std::string sExtension(".y4m");
+    if ((sFilePath.length() >= sExtension.length()) && (sFilePath.compare(sFilePath.length() - sExtension.length(), sExtension.length(), sExtension) == 0)) return VIDEO_FORMAT::Y4M;
+
+    return VIDEO_FORMAT::PPM_SEQUENCE;
+  }
+
+
+  // ** cVideoExporter
+
+  cVideoExporter::cPipeline::cPipeline() :
+    simulatedFrames(nPoolSize),
+    frames(nPoolSize),
+    simulatedFramesFree(nPoolSize),
+    simulatedFramesFull(nQueueDepth),
+    framesFree(nPoolSize),
+    framesFull(nQueueDepth)
+  {
+    for (size_t i = 0; i < nPoolSize; i++) {
+      simulatedFramesFree.Push(&simulatedFrames[i]);
+      framesFree.Push(&frames[i]);
+    }
+  }
+
+  cVideoExporter::cVideoExporter() :
+    width(TETRIS_VIDEO_TARGET_WIDTH),
+    height(TETRIS_VIDEO_TARGET_HEIGHT),
+    framesPerSecond(DEFAULT_FRAMES_PER_SECOND),
+    nFramesWritten(0),
+    bIsError(false)
+  {
+  }
+
+  void cVideoExporter::SetSize(size_t _width, size_t _height)
+  {
+    assert(_width != 0);
+    assert(_height != 0);
+    width = _width;
+    height = _height;
+  }
+
+  void cVideoExporter::SetFramesPerSecond(size_t _framesPerSecond)
+  {
+    assert(_framesPerSecond != 0);
+    framesPerSecond = _framesPerSecond;
+  }
+
+  void cVideoExporter::SetPlayer(size_t i, const std::string& sName, const spitfire::math::cColour& colour)
+  {
+    if (i >= players.size()) players.resize(i + 1);
+
+    players[i].sName = sName;
+    players[i].colour = colour;
+  }
+
+  bool cVideoExporter::Export(const cReplay& replay, VIDEO_FORMAT format, const std::string& sOutput)
+  {
+    nFramesWritten = 0;
+    bIsError = false;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    cPipeline pipeline;
+
+    std::thread threadSimulate(&cVideoExporter::_Simulate, this, std::ref(pipeline), std::cref(replay));
+    std::thread threadRasterize(&cVideoExporter::_Rasterize, this, std::ref(pipeline));
+
+    _Encode(pipeline, format, sOutput);
+
+    threadRasterize.join();
+    threadSimulate.join();
+
+    const std::chrono::milliseconds duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    const uint64_t gameDurationMS = replay.GetTicks() * SIMULATION_TICK_MS;
+    std::cout<<"cVideoExporter::Export "<<nFramesWritten<<" frames, "<<gameDurationMS<<"ms of game in "<<duration.count()<<"ms"<<std::endl;
+
+    return !bIsError;
+  }
+
+  void cVideoExporter::_Simulate(cPipeline& pipeline, const cReplay& replay)
+  {
+    cReplayPlayer player(replay);
+
+    cEventBuffer events;
+
+    for (size_t i = 0; ; i++) {
+      // Catch up to the time of this frame, the first frame is the starting state
+      const spitfire::durationms_t frameTime = replay.GetStartTime() + spitfire::durationms_t((uint64_t(i) * 1000) / framesPerSecond);
+      while (!player.IsFinished() && (player.GetCurrentTime() < frameTime)) player.Step(events);
+
+      cSimulatedFrame* pSimulatedFrame = nullptr;
+      pipeline.simulatedFramesFree.Pop(pSimulatedFrame);
+
+      player.GetSnapshot(pSimulatedFrame->snapshot);
+      pSimulatedFrame->events.Clear();
+      pSimulatedFrame->events.Swap(events);
+
+      pipeline.simulatedFramesFull.Push(pSimulatedFrame);
+
+      if (player.IsFinished()) break;
+    }
+
+    pipeline.simulatedFramesFull.Close();
+  }
+
+  void cVideoExporter::_Rasterize(cPipeline& pipeline)
+  {
+    // A new renderer each time so that nothing is cached from a previous replay
+    cSoftwareRenderer renderer;
+    for (size_t i = 0; i < players.size(); i++) renderer.SetPlayer(i, players[i].sName, players[i].colour);
+
+    cSimulatedFrame* pSimulatedFrame = nullptr;
+    while (pipeline.simulatedFramesFull.Pop(pSimulatedFrame)) {
+      cFrame* pFrame = nullptr;
+      pipeline.framesFree.Pop(pFrame);
+
+      if ((pFrame->GetWidth() != width) || (pFrame->GetHeight() != height)) pFrame->Resize(width, height);
+
+      pSimulatedFrame->events.Coalesce();
+      pSimulatedFrame->events.Dispatch(pSimulatedFrame->snapshot, renderer);
+      renderer.Render(pSimulatedFrame->snapshot, *pFrame);
+
+      pipeline.simulatedFramesFree.Push(pSimulatedFrame);
+      pipeline.framesFull.Push(pFrame);
+    }
+
+    pipeline.framesFull.Close();
+  }
+
+  void cVideoExporter::_Encode(cPipeline& pipeline, VIDEO_FORMAT format, const std::string& sOutput)
+  {
+    std::ofstream file;
+    if (format == VIDEO_FORMAT::Y4M) {
+      file.open(sOutput.c_str(), std::ios::binary);
+      if (!file.good()) {
+        std::cout<<"cVideoExporter::_Encode Error opening \""<<sOutput<<"\""<<std::endl;
+        bIsError = true;
+      }
+    }
+
+    cY4MWriter writer(file);
+
+    // Keep taking frames after an error so that the other stages can finish
+    cFrame* pFrame = nullptr;
+    while (pipeline.framesFull.Pop(pFrame)) {
+      if (!bIsError) {
+        if (format == VIDEO_FORMAT::Y4M) {
+          writer.WriteFrame(*pFrame, framesPerSecond);
+          bIsError = !file.good();
+        } else {
+          std::ostringstream o;
+          o<<sOutput<<"/frame_"<<std::setw(6)<<std::setfill('0')<<nFramesWritten<<".ppm";
+          std::ofstream image(o.str().c_str(), std::ios::binary);
+          pFrame->WritePPM(image);
+          bIsError = !image.good();
+        }
+
+        if (bIsError) std::cout<<"cVideoExporter::_Encode Error writing frame "<<nFramesWritten<<" to \""<<sOutput<<"\""<<std::endl;
+        else nFramesWritten++;
+      }
+
+      pipeline.framesFree.Push(pFrame);
+    }
+  }
+
+  int ExportReplayToVideo(const std::string& sReplayFilePath, const std::string& sOutput)
+  {
+    cReplay replay;
+    if (!replay.Load(sReplayFilePath)) return EXIT_FAILURE;
+
+    cVideoExporter exporter;
+
+    // The replay doesn't know which boards were spectators so we label the boards the same as a two player game
+    const size_t nPlayers = std::min<size_t>(replay.GetBoards(), 2);
+    for (size_t i = 0; i < nPlayers; i++) {
+      std::ostringstream o;
+      o<<"Player "<<(i + 1);
+      exporter.SetPlayer(i, o.str(), spitfire::math::cColour(1.0f, 1.0f, 1.0f));
+    }
+
+    return exporter.Export(replay, GetVideoFormatFromFilePath(sOutput), sOutput) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,169 @@
+#ifndef TETRIS_VIDEOEXPORT_H
+#define TETRIS_VIDEOEXPORT_H
+
+// Standard headers
+#include <cassert>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Tetris headers
+#include "replay.h"
+#include "softwarerenderer.h"
+
+namespace tetris
+{
+  // ** cBoundedQueue
+  //
+  // A queue with a fixed capacity between the stages of a pipeline.  Push waits while the queue is full and Pop waits
+  // while it is empty, so a fast stage can only get a few items ahead of a slow one.  After Close has been called Pop
+  // returns false once the queue is empty.
+
+  template <class T>
+  class cBoundedQueue
+  {
+  public:
+    explicit cBoundedQueue(size_t capacity);
+
+    void Push(const T& value);
+    bool Pop(T& value);
+
+    void Close();
+
+  private:
+    const size_t capacity;
+    bool bIsClosed;
+
+    std::deque<T> items;
+
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+  };
+
+  template <class T>
+  inline cBoundedQueue<T>::cBoundedQueue(size_t _capacity) :
+    capacity(_capacity),
+    bIsClosed(false)
+  {
+    assert(capacity != 0);
+  }
+
+  template <class T>
+  inline void cBoundedQueue<T>::Push(const T& value)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (items.size() >= capacity) notFull.wait(lock);
+
+    items.push_back(value);
+    notEmpty.notify_one();
+  }
+
+  template <class T>
+  inline bool cBoundedQueue<T>::Pop(T& value)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (items.empty()) {
+      if (bIsClosed) return false;
+      notEmpty.wait(lock);
+    }
+
+    value = items.front();
+    items.pop_front();
+    notFull.notify_one();
+
+    return true;
+  }
+
+  template <class T>
+  inline void cBoundedQueue<T>::Close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    bIsClosed = true;
+    notEmpty.notify_all();
+  }
+
+
+  // ** cVideoExporter
+  //
+  // Turns a replay into a video without a window.  The replay is simulated, rasterized with cSoftwareRenderer and encoded
+  // in three stages connected by bounded queues, the first two on worker threads and the encoding on the calling thread,
+  // so on a multi-core machine all three overlap.  The snapshots and frames are allocated up front and passed back to
+  // the start of the pipeline once they have been used, so nothing is allocated per frame and the memory used does not
+  // depend on the length of the replay.
+
+  enum class VIDEO_FORMAT {
+    Y4M,
+    PPM_SEQUENCE,
+  };
+
+  // ".y4m" files are written as a single stream, anything else is treated as a directory to write numbered PPM files to
+  VIDEO_FORMAT GetVideoFormatFromFilePath(const std::string& sFilePath);
+
+  class cVideoExporter
+  {
+  public:
+    cVideoExporter();
+
+    void SetSize(size_t width, size_t height);
+    void SetFramesPerSecond(size_t framesPerSecond);
+    void SetPlayer(size_t i, const std::string& sName, const spitfire::math::cColour& colour);
+
+    bool Export(const cReplay& replay, VIDEO_FORMAT format, const std::string& sOutput);
+
+    size_t GetFramesWritten() const { return nFramesWritten; }
+
+  private:
+    struct cSimulatedFrame
+    {
+      cGameSnapshot snapshot;
+      cEventBuffer events; // Every event since the previous frame
+    };
+
+    // How far each stage can get ahead of the next one, plus one item being worked on by each side of a queue
+    static const size_t nQueueDepth = 4;
+    static const size_t nPoolSize = nQueueDepth + 2;
+
+    class cPipeline
+    {
+    public:
+      cPipeline();
+
+      std::vector<cSimulatedFrame> simulatedFrames;
+      std::vector<cFrame> frames;
+
+      cBoundedQueue<cSimulatedFrame*> simulatedFramesFree;
+      cBoundedQueue<cSimulatedFrame*> simulatedFramesFull;
+      cBoundedQueue<cFrame*> framesFree;
+      cBoundedQueue<cFrame*> framesFull;
+    };
+
+    void _Simulate(cPipeline& pipeline, const cReplay& replay);
+    void _Rasterize(cPipeline& pipeline);
+    void _Encode(cPipeline& pipeline, VIDEO_FORMAT format, const std::string& sOutput);
+
+    size_t width;
+    size_t height;
+    size_t framesPerSecond;
+
+    struct cPlayer
+    {
+      std::string sName;
+      spitfire::math::cColour colour;
+    };
+
+    std::vector<cPlayer> players;
+
+    // Only used by the encode stage
+    size_t nFramesWritten;
+    bool bIsError;
+  };
+
+  // Loads a replay and writes it out with the default size and frame rate, returns an exit code for main
+  int ExportReplayToVideo(const std::string& sReplayFilePath, const std::string& sOutput);
+}
+
+#endif // TETRIS_VIDEOEXPORT_H